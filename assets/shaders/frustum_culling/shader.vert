@@ -1,9 +0,0 @@
-#version 430
-
-in vec3 pos;
-out vec3 vPos;
-
-void main()
-{
-	vPos = pos;
-}
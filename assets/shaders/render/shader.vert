@@ -1,18 +1,89 @@
 #version 430
+#extension GL_ARB_shader_draw_parameters : require
 
-layout(location=0) in vec3 pos;
-layout(location=1) in vec3 normal;
-layout(location=2) in vec3 texcoords;
+// Merged faces of the bound heap page, packed as described in Mesher::Quad.
+//  Vertex 4*q + c is corner c of quad q; the index buffer turns each quad's
+//  corners into two triangles.
+layout(std430, binding = 6) readonly buffer Quads { uvec2 quads[]; };
+// Origin of every chunk, numbered x*worldChunks.y + y. Each draw command's
+//  base instance is the number of the chunk it draws.
+layout(std430, binding = 7) readonly buffer ChunkOrigins { vec4 chunkOrigins[]; };
 uniform mat4 view;
 uniform mat4 projection;
-uniform mat4 model;
 out vec3 vNormal;
 out vec3 vTexcoords;
 
+const vec3 normals[6] = {
+	vec3( 0, 0,-1),
+	vec3(-1, 0, 0),
+	vec3( 0,-1, 0),
+	vec3( 1, 0, 0),
+	vec3( 0, 1, 0),
+	vec3( 0, 0, 1),
+};
+
+// Axes the width and height of a quad run along, see the generate shaders
+const ivec3 uAxes[6] = {
+	ivec3( 1, 0, 0),
+	ivec3( 0, 1, 0),
+	ivec3( 1, 0, 0),
+	ivec3( 0, 1, 0),
+	ivec3( 1, 0, 0),
+	ivec3( 1, 0, 0),
+};
+const ivec3 vAxes[6] = {
+	ivec3( 0, 1, 0),
+	ivec3( 0, 0, 1),
+	ivec3( 0, 0, 1),
+	ivec3( 0, 0, 1),
+	ivec3( 0, 0, 1),
+	ivec3( 0, 1, 0),
+};
+// Axes the texture coordinates run along, so merged faces repeat the
+//  block's texture instead of stretching it
+const ivec2 texAxes[6] = {
+	ivec2(0, 1),
+	ivec2(2, 1),
+	ivec2(0, 2),
+	ivec2(2, 1),
+	ivec2(0, 2),
+	ivec2(1, 0),
+};
+
+// Corners of a quad relative to its first block, scaled by its extent,
+//  and their texture coordinates
+const vec3 corner_offsets[6][4] = {
+	{vec3(0,0,0), vec3(1,0,0), vec3(0,1,0), vec3(1,1,0)},
+	{vec3(0,0,0), vec3(0,1,0), vec3(0,0,1), vec3(0,1,1)},
+	{vec3(0,0,0), vec3(0,0,1), vec3(1,0,0), vec3(1,0,1)},
+	{vec3(1,1,1), vec3(1,1,0), vec3(1,0,1), vec3(1,0,0)},
+	{vec3(1,1,1), vec3(0,1,1), vec3(1,1,0), vec3(0,1,0)},
+	{vec3(1,1,1), vec3(1,0,1), vec3(0,1,1), vec3(0,0,1)},
+};
+const vec2 corner_texcoords[6][4] = {
+	{vec2(0,0), vec2(1,0), vec2(0,1), vec2(1,1)},
+	{vec2(0,0), vec2(0,1), vec2(1,0), vec2(1,1)},
+	{vec2(0,0), vec2(0,1), vec2(1,0), vec2(1,1)},
+	{vec2(1,1), vec2(0,1), vec2(1,0), vec2(0,0)},
+	{vec2(1,1), vec2(0,1), vec2(1,0), vec2(0,0)},
+	{vec2(1,1), vec2(0,1), vec2(1,0), vec2(0,0)},
+};
+
 void main()
 {
-	mat4 trans = projection*view*model;
-	vNormal = normalize(transpose(inverse(mat3(trans)))*normal);
-	vTexcoords = texcoords;
+	uvec2 quad = quads[gl_VertexID/4];
+	int corner = gl_VertexID%4;
+	vec3 first = vec3(quad.x & 15u, (quad.x >> 4) & 15u, (quad.x >> 8) & 255u);
+	int n = int(quad.x >> 28);
+	ivec3 extent = ivec3(1)
+		+ int((quad.x >> 16) & 15u)*uAxes[n]
+		+ int((quad.x >> 20) & 255u)*vAxes[n];
+	vec2 repeat = vec2(extent[texAxes[n].x], extent[texAxes[n].y]);
+	vec3 pos = chunkOrigins[gl_BaseInstanceARB].xyz + first
+		+ corner_offsets[n][corner]*vec3(extent);
+
+	mat4 trans = projection*view;
+	vNormal = normalize(transpose(inverse(mat3(trans)))*normals[n]);
+	vTexcoords = vec3(corner_texcoords[n][corner]*repeat, quad.y);
 	gl_Position = trans*vec4(pos, 1.0);
 }
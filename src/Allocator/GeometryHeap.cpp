@@ -0,0 +1,197 @@
+#include <Allocator/GeometryHeap.hpp>
+
+#include <algorithm>
+#include <cstdio>
+
+constexpr GeometryHeap::Handle GeometryHeap::none;
+
+GeometryHeap::GeometryHeap(uint32_t page_size):
+	m_page_size{page_size}
+{;}
+
+void GeometryHeap::add_free(uint32_t page, uint32_t first, uint32_t size) {
+	std::map<uint32_t, uint32_t> &free = m_pages[page].free;
+	// Merge with the free ranges right after and right before
+	auto next = free.find(first+size);
+	if(next != free.end()) {
+		size += next->second;
+		m_by_size.erase(std::make_tuple(next->second, page, next->first));
+		free.erase(next);
+	}
+	auto it = free.lower_bound(first);
+	if(it != free.begin()) {
+		auto previous = std::prev(it);
+		if(previous->first + previous->second == first) {
+			first = previous->first;
+			size += previous->second;
+			m_by_size.erase(std::make_tuple(previous->second, page, previous->first));
+			free.erase(previous);
+		}
+	}
+	free[first] = size;
+	m_by_size.insert(std::make_tuple(size, page, first));
+}
+
+void GeometryHeap::remove_free(uint32_t page, uint32_t first, uint32_t size) {
+	m_pages[page].free.erase(first);
+	m_by_size.erase(std::make_tuple(size, page, first));
+}
+
+GeometryHeap::Handle GeometryHeap::allocate(uint32_t size) {
+	Allocation allocation{0, 0, size, true};
+	if(size) {
+		auto it = m_by_size.lower_bound(std::make_tuple(size, 0u, 0u));
+		if(it == m_by_size.end()) {
+			m_pages.push_back(Page{std::max(m_page_size, size), 0, {}});
+			add_free(m_pages.size()-1, 0, m_pages.back().capacity);
+			it = m_by_size.lower_bound(std::make_tuple(size, 0u, 0u));
+		}
+		uint32_t range_size, page, first;
+		std::tie(range_size, page, first) = *it;
+		remove_free(page, first, range_size);
+		if(range_size > size)
+			add_free(page, first+size, range_size-size);
+		m_pages[page].used += size;
+		allocation.page = page;
+		allocation.first = first;
+	}
+
+	if(!m_free_handles.empty()) {
+		Handle handle = m_free_handles.back();
+		m_free_handles.pop_back();
+		m_allocations[handle] = allocation;
+		return handle;
+	}
+	m_allocations.push_back(allocation);
+	return m_allocations.size()-1;
+}
+
+void GeometryHeap::free(Handle handle) {
+	if(handle == none)
+		return;
+	Allocation &allocation = m_allocations[handle];
+	// Freeing a handle twice would hand its range out twice
+	if(!allocation.live)
+		return;
+	if(allocation.size) {
+		m_pages[allocation.page].used -= allocation.size;
+		add_free(allocation.page, allocation.first, allocation.size);
+	}
+	allocation.live = false;
+	m_free_handles.push_back(handle);
+}
+
+uint32_t GeometryHeap::page(Handle handle) const {
+	return m_allocations[handle].page;
+}
+
+uint32_t GeometryHeap::first(Handle handle) const {
+	return m_allocations[handle].first;
+}
+
+uint32_t GeometryHeap::size(Handle handle) const {
+	return m_allocations[handle].size;
+}
+
+size_t GeometryHeap::page_count() const {
+	return m_pages.size();
+}
+
+uint32_t GeometryHeap::page_capacity(uint32_t page) const {
+	return m_pages[page].capacity;
+}
+
+float GeometryHeap::fragmentation(uint32_t page) const {
+	const Page &p = m_pages[page];
+	uint32_t free = p.capacity - p.used;
+	if(!free)
+		return 0.f;
+	uint32_t largest = 0;
+	for(auto &range : p.free)
+		largest = std::max(largest, range.second);
+	return 1.f - static_cast<float>(largest)/free;
+}
+
+void GeometryHeap::defragment(uint32_t page, std::vector<Move> &moves) {
+	std::vector<Handle> handles;
+	for(Handle h=0;h<m_allocations.size();++h) {
+		const Allocation &allocation = m_allocations[h];
+		if(allocation.live && allocation.size && allocation.page == page)
+			handles.push_back(h);
+	}
+	std::sort(handles.begin(), handles.end(), [&](Handle a, Handle b) {
+		return m_allocations[a].first < m_allocations[b].first;
+	});
+
+	moves.clear();
+	uint32_t next = 0;
+	for(Handle h : handles) {
+		Allocation &allocation = m_allocations[h];
+		moves.push_back(Move{allocation.first, next, allocation.size});
+		allocation.first = next;
+		next += allocation.size;
+	}
+
+	Page &p = m_pages[page];
+	for(auto &range : p.free)
+		m_by_size.erase(std::make_tuple(range.second, page, range.first));
+	p.free.clear();
+	if(next < p.capacity)
+		add_free(page, next, p.capacity-next);
+}
+
+GeometryHeap::Stats GeometryHeap::stats() const {
+	Stats stats{};
+	stats.pages = m_pages.size();
+	for(const Page &p : m_pages) {
+		stats.capacity += p.capacity;
+		stats.used += p.used;
+		stats.free_ranges += p.free.size();
+	}
+	stats.allocations = m_allocations.size() - m_free_handles.size();
+	if(!m_by_size.empty())
+		stats.largest_free = std::get<0>(*m_by_size.rbegin());
+	return stats;
+}
+
+std::string GeometryHeap::report() const {
+	Stats s = stats();
+	char line[256];
+	std::snprintf(
+		line, sizeof(line),
+		"Geometry heap: %zu pages, %llu of %llu elements used (%.1f%%), "
+		"%zu allocations, %zu free ranges, largest %llu\n",
+		s.pages, static_cast<unsigned long long>(s.used),
+		static_cast<unsigned long long>(s.capacity),
+		s.capacity ? 100.0*s.used/s.capacity : 0.0, s.allocations,
+		s.free_ranges, static_cast<unsigned long long>(s.largest_free)
+	);
+	return line;
+}
+
+bool GeometryHeap::check() const {
+	std::vector<std::vector<std::pair<uint32_t, uint32_t>>> ranges(m_pages.size());
+	for(size_t p=0;p<m_pages.size();++p) {
+		for(auto &range : m_pages[p].free)
+			ranges[p].push_back(range);
+	}
+	for(const Allocation &allocation : m_allocations) {
+		if(allocation.live && allocation.size) {
+			if(allocation.page >= m_pages.size())
+				return false;
+			ranges[allocation.page].emplace_back(allocation.first, allocation.size);
+		}
+	}
+	for(size_t p=0;p<m_pages.size();++p) {
+		std::sort(ranges[p].begin(), ranges[p].end());
+		uint32_t next = 0;
+		for(auto &range : ranges[p]) {
+			if(range.first != next)
+				return false;
+			next += range.second;
+		}
+		if(next != m_pages[p].capacity)
+			return false;
+	}
+	return m_by_size.size() == stats().free_ranges;
+}
@@ -0,0 +1,101 @@
+#ifndef GEOMETRY_HEAP
+#define GEOMETRY_HEAP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Sub-allocates ranges of elements (e.g. mesh quads) from a few large
+//  pages, each meant to be backed by one GPU buffer. The heap itself only
+//  does the bookkeeping, so it works for any kind of buffer and without a
+//  context.
+//
+//  Free ranges are kept per page sorted by offset, so a freed range is
+//  merged with the free ranges next to it, and in one set sorted by size,
+//  for best fit allocation over all pages. A new page is added once no
+//  free range is large enough, sized to fit if the allocation is larger
+//  than a page.
+//
+//  Allocations are referred to by handles that stay valid until freed.
+//  defragment moves a page's allocations together; the caller copies the
+//  moved ranges into a new buffer and the handles then point at their new
+//  places.
+class GeometryHeap
+{
+public:
+	using Handle = uint32_t;
+	static constexpr Handle none = ~0u;
+
+	// A range that defragment moved, from the old buffer to the new one
+	struct Move {
+		uint32_t from;
+		uint32_t to;
+		uint32_t size;
+	};
+
+	struct Stats {
+		size_t pages;
+		uint64_t capacity;
+		uint64_t used;
+		size_t allocations;
+		size_t free_ranges;
+		uint64_t largest_free;
+	};
+
+private:
+	struct Allocation {
+		uint32_t page;
+		uint32_t first;
+		uint32_t size;
+		bool live;
+	};
+	struct Page {
+		uint32_t capacity;
+		uint32_t used;
+		// Free ranges, first element to size
+		std::map<uint32_t, uint32_t> free;
+	};
+
+	uint32_t m_page_size;
+	std::vector<Page> m_pages;
+	std::vector<Allocation> m_allocations;
+	std::vector<Handle> m_free_handles;
+	// Every free range as (size, page, first)
+	std::set<std::tuple<uint32_t, uint32_t, uint32_t>> m_by_size;
+
+	void add_free(uint32_t page, uint32_t first, uint32_t size);
+	void remove_free(uint32_t page, uint32_t first, uint32_t size);
+public:
+	// Handles of empty allocations are valid but take up no space
+	Handle allocate(uint32_t size);
+	// Freeing none or an already freed handle does nothing
+	void free(Handle handle);
+
+	uint32_t page(Handle handle) const;
+	uint32_t first(Handle handle) const;
+	uint32_t size(Handle handle) const;
+
+	size_t page_count() const;
+	uint32_t page_capacity(uint32_t page) const;
+	// Share of the page's free space that lies outside its largest free
+	//  range, 0 if the free space is in one piece
+	float fragmentation(uint32_t page) const;
+	// Moves every allocation of the page to the start of it, in order.
+	//  moves receives the ranges to copy from the old contents.
+	void defragment(uint32_t page, std::vector<Move> &moves);
+
+	Stats stats() const;
+	// One line describing pages, usage and fragmentation
+	std::string report() const;
+	// Whether the free and allocated ranges of every page cover it exactly
+	//  once
+	bool check() const;
+
+	explicit GeometryHeap(uint32_t page_size);
+};
+
+#endif
@@ -0,0 +1,185 @@
+#include <Allocator/SlabAllocator.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	constexpr size_t huge_page_size = 2*1024*1024;
+#ifdef VOXELATOR_HUGE_PAGES
+	constexpr bool use_huge_pages = true;
+#else
+	constexpr bool use_huge_pages = false;
+#endif
+
+	size_t page_size() {
+#ifdef _WIN32
+		return 4096;
+#else
+		long size = sysconf(_SC_PAGESIZE);
+		return size > 0 ? static_cast<size_t>(size) : 4096;
+#endif
+	}
+
+	void *allocate_arena(size_t size, size_t alignment) {
+#ifdef _WIN32
+		return _aligned_malloc(size, alignment);
+#else
+		void *p = nullptr;
+		if(posix_memalign(&p, alignment, size))
+			return nullptr;
+		return p;
+#endif
+	}
+
+	void free_arena(void *p) {
+#ifdef _WIN32
+		_aligned_free(p);
+#else
+		free(p);
+#endif
+	}
+}
+
+void SlabPool::grow() {
+	size_t alignment = m_huge_pages ? huge_page_size : page_size();
+	void *arena = allocate_arena(m_arena_size, alignment);
+	if(!arena)
+		throw std::bad_alloc();
+#if defined(MADV_HUGEPAGE)
+	if(m_huge_pages)
+		madvise(arena, m_arena_size, MADV_HUGEPAGE);
+#endif
+	m_arenas.push_back(arena);
+
+	// Thread the new blocks onto the free list in address order, so
+	//  consecutive allocations are adjacent in memory.
+	uint8_t *base = static_cast<uint8_t*>(arena);
+	size_t count = m_arena_size/m_block_size;
+	for(size_t i=count;i-->0;) {
+		FreeBlock *block = reinterpret_cast<FreeBlock*>(base + i*m_block_size);
+		block->next = m_free;
+		m_free = block;
+	}
+}
+
+void *SlabPool::allocate() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if(!m_free)
+		grow();
+
+	FreeBlock *block = m_free;
+	m_free = block->next;
+
+	// The free list is LIFO, so a block that was never handed out before is
+	//  only used when usage exceeds its previous peak.
+	++m_allocations;
+	++m_blocks_in_use;
+	if(m_blocks_in_use > m_blocks_peak)
+		m_blocks_peak = m_blocks_in_use;
+	else
+		++m_recycled;
+	return block;
+}
+
+void SlabPool::deallocate(void *p) {
+	if(!p)
+		return;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	FreeBlock *block = static_cast<FreeBlock*>(p);
+	block->next = m_free;
+	m_free = block;
+	--m_blocks_in_use;
+}
+
+bool SlabPool::owns(const void *p) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const uint8_t *byte = static_cast<const uint8_t*>(p);
+	for(auto arena : m_arenas) {
+		const uint8_t *base = static_cast<const uint8_t*>(arena);
+		if(byte >= base && byte < base + m_arena_size)
+			return true;
+	}
+	return false;
+}
+
+size_t SlabPool::block_size() const {
+	return m_block_size;
+}
+
+std::string SlabPool::report() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	char line[256];
+	std::snprintf(
+		line, sizeof(line),
+		"%7zu byte blocks: %zu arenas, %.1f MiB reserved, %zu in use "
+		"(peak %zu), %zu allocations, %zu recycled%s",
+		m_block_size, m_arenas.size(),
+		m_arenas.size()*m_arena_size/(1024.0*1024.0),
+		m_blocks_in_use, m_blocks_peak, m_allocations, m_recycled,
+		m_huge_pages ? ", huge pages" : ""
+	);
+	return line;
+}
+
+SlabPool::SlabPool(size_t block_size, size_t arena_size, bool huge_pages):
+	m_block_size{std::max(block_size, sizeof(FreeBlock))},
+	m_huge_pages{huge_pages},
+	m_free{nullptr},
+	m_blocks_in_use{0},
+	m_blocks_peak{0},
+	m_allocations{0},
+	m_recycled{0}
+{
+	size_t alignment = huge_pages ? huge_page_size : page_size();
+	arena_size = std::max(arena_size, m_block_size);
+	arena_size = (arena_size + m_block_size - 1)/m_block_size*m_block_size;
+	m_arena_size = (arena_size + alignment - 1)/alignment*alignment;
+}
+
+SlabPool::~SlabPool() {
+	for(auto arena : m_arenas)
+		free_arena(arena);
+}
+
+
+// The pools are never destroyed, so buffers owned by other static objects
+//  can still be released during exit.
+SlabPool &SlabAllocator::chunk_pool() {
+	// 32 chunks per arena, one 2 MiB huge page
+	static SlabPool &pool = *new SlabPool(chunk_bytes, 32*chunk_bytes, use_huge_pages);
+	return pool;
+}
+
+SlabPool &SlabAllocator::section_pool() {
+	static SlabPool &pool = *new SlabPool(section_bytes, 512*section_bytes, use_huge_pages);
+	return pool;
+}
+
+void *SlabAllocator::allocate(size_t bytes) {
+	if(bytes == chunk_bytes)
+		return chunk_pool().allocate();
+	if(bytes == section_bytes)
+		return section_pool().allocate();
+	return ::operator new(bytes);
+}
+
+void SlabAllocator::deallocate(void *p, size_t bytes) {
+	if(bytes == chunk_bytes)
+		chunk_pool().deallocate(p);
+	else if(bytes == section_bytes)
+		section_pool().deallocate(p);
+	else
+		::operator delete(p);
+}
+
+std::string SlabAllocator::report() {
+	return chunk_pool().report() + "\n" + section_pool().report() + "\n";
+}
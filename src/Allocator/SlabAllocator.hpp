@@ -0,0 +1,99 @@
+#ifndef SLAB_ALLOCATOR
+#define SLAB_ALLOCATOR
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Hands out fixed-size blocks carved from large page-aligned arenas. Freed
+//  blocks go onto a free list and are reused before a new arena is
+//  allocated; arenas are only released when the pool is destroyed.
+class SlabPool
+{
+private:
+	struct FreeBlock {
+		FreeBlock *next;
+	};
+
+	size_t m_block_size;
+	size_t m_arena_size;
+	bool m_huge_pages;
+	std::mutex m_mutex;
+	std::vector<void*> m_arenas;
+	FreeBlock *m_free;
+
+	size_t m_blocks_in_use;
+	size_t m_blocks_peak;
+	size_t m_allocations;
+	size_t m_recycled;
+
+	void grow();
+public:
+	void *allocate();
+	void deallocate(void *block);
+	// True if p points into one of this pool's arenas
+	bool owns(const void *p);
+
+	size_t block_size() const;
+	// One line describing reserved memory and block usage
+	std::string report();
+
+	// arena_size is rounded up to a multiple of block_size. With huge_pages,
+	//  arenas are aligned to 2 MiB and the kernel is asked to back them with
+	//  huge pages.
+	SlabPool(size_t block_size, size_t arena_size, bool huge_pages);
+	~SlabPool();
+	SlabPool(const SlabPool&) = delete;
+	SlabPool &operator=(const SlabPool&) = delete;
+};
+
+// Routes chunk and section sized allocations to their pools, everything
+//  else goes to operator new.
+namespace SlabAllocator {
+	// 16x16x256 chunk and 16x16x16 section of one byte voxels
+	constexpr size_t chunk_bytes = 16*16*256;
+	constexpr size_t section_bytes = 16*16*16;
+
+	SlabPool &chunk_pool();
+	SlabPool &section_pool();
+
+	void *allocate(size_t bytes);
+	void deallocate(void *p, size_t bytes);
+	std::string report();
+}
+
+// Standard allocator drawing from SlabAllocator, so containers of chunk
+//  and section size land in the pools.
+template<typename T>
+class PoolAllocator
+{
+public:
+	using value_type = T;
+
+	T *allocate(size_t n) {
+		return static_cast<T*>(SlabAllocator::allocate(n*sizeof(T)));
+	}
+	void deallocate(T *p, size_t n) {
+		SlabAllocator::deallocate(p, n*sizeof(T));
+	}
+
+	PoolAllocator() = default;
+	template<typename U>
+	PoolAllocator(const PoolAllocator<U>&) {}
+};
+
+template<typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+	return true;
+}
+template<typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+	return false;
+}
+
+// Voxel storage for chunks and sections
+using VoxelBuffer = std::vector<uint8_t, PoolAllocator<uint8_t>>;
+
+#endif
@@ -0,0 +1,169 @@
+#include <Codec/Codec.hpp>
+
+#include <cstring>
+#include <zlib.h>
+#ifdef VOXELATOR_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+Codec::~Codec() {
+
+}
+
+const Codec *Codec::get(uint8_t compression) {
+	auto list = backends(compression);
+	if(list.empty())
+		return nullptr;
+	return list.front();
+}
+
+std::vector<const Codec*> Codec::backends(uint8_t compression) {
+	static const ZlibCodec zlib_gzip(MC::Compression::GZIP);
+	static const ZlibCodec zlib_zlib(MC::Compression::ZLIB);
+	static const StoredCodec stored;
+#ifdef VOXELATOR_LIBDEFLATE
+	static const LibdeflateCodec libdeflate_gzip(MC::Compression::GZIP);
+	static const LibdeflateCodec libdeflate_zlib(MC::Compression::ZLIB);
+#endif
+
+	switch(compression) {
+		case MC::Compression::GZIP:
+#ifdef VOXELATOR_LIBDEFLATE
+			return {&libdeflate_gzip, &zlib_gzip};
+#else
+			return {&zlib_gzip};
+#endif
+		case MC::Compression::ZLIB:
+#ifdef VOXELATOR_LIBDEFLATE
+			return {&libdeflate_zlib, &zlib_zlib};
+#else
+			return {&zlib_zlib};
+#endif
+		case MC::Compression::NONE:
+			return {&stored};
+	}
+	return {};
+}
+
+
+const char *ZlibCodec::name() const {
+	return m_name;
+}
+
+bool ZlibCodec::decompress(
+	const uint8_t *src, size_t src_len, std::vector<uint8_t> &dst, size_t &len
+) const {
+	z_stream stream;
+	std::memset(&stream, 0, sizeof(stream));
+	if(inflateInit2(&stream, m_window_bits) != Z_OK)
+		return false;
+
+	if(dst.size() < 4096)
+		dst.resize(4096);
+
+	stream.next_in = const_cast<uint8_t*>(src);
+	stream.avail_in = src_len;
+
+	int status;
+	do {
+		if(stream.total_out == dst.size())
+			dst.resize(dst.size()*2);
+		stream.next_out = dst.data() + stream.total_out;
+		stream.avail_out = dst.size() - stream.total_out;
+		status = inflate(&stream, Z_NO_FLUSH);
+	} while(status == Z_OK || (status == Z_BUF_ERROR && stream.avail_out == 0));
+
+	len = stream.total_out;
+	inflateEnd(&stream);
+	return status == Z_STREAM_END;
+}
+
+ZlibCodec::ZlibCodec(uint8_t compression) {
+	// 15 is the largest deflate window, +16 makes zlib expect a gzip header
+	if(compression == MC::Compression::GZIP) {
+		m_window_bits = 15 + 16;
+		m_name = "zlib-gzip";
+	}
+	else {
+		m_window_bits = 15;
+		m_name = "zlib-zlib";
+	}
+}
+
+
+const char *StoredCodec::name() const {
+	return "stored";
+}
+
+bool StoredCodec::decompress(
+	const uint8_t *src, size_t src_len, std::vector<uint8_t> &dst, size_t &len
+) const {
+	if(dst.size() < src_len)
+		dst.resize(src_len);
+	std::memcpy(dst.data(), src, src_len);
+	len = src_len;
+	return true;
+}
+
+
+#ifdef VOXELATOR_LIBDEFLATE
+namespace {
+	// libdeflate decompressors are not thread safe, so every thread gets its
+	//  own, allocated on first use.
+	struct DecompressorHolder {
+		libdeflate_decompressor *d = libdeflate_alloc_decompressor();
+		~DecompressorHolder() {
+			libdeflate_free_decompressor(d);
+		}
+	};
+	libdeflate_decompressor *thread_decompressor() {
+		static thread_local DecompressorHolder holder;
+		return holder.d;
+	}
+}
+
+const char *LibdeflateCodec::name() const {
+	return m_name;
+}
+
+bool LibdeflateCodec::decompress(
+	const uint8_t *src, size_t src_len, std::vector<uint8_t> &dst, size_t &len
+) const {
+	libdeflate_decompressor *d = thread_decompressor();
+	if(!d)
+		return false;
+
+	if(dst.size() < src_len*4)
+		dst.resize(src_len*4);
+
+	// libdeflate wants the whole output buffer up front, so grow and retry
+	//  until the chunk fits.
+	for(;;) {
+		libdeflate_result result;
+		if(m_compression == MC::Compression::GZIP) {
+			result = libdeflate_gzip_decompress(
+				d, src, src_len, dst.data(), dst.size(), &len
+			);
+		}
+		else {
+			result = libdeflate_zlib_decompress(
+				d, src, src_len, dst.data(), dst.size(), &len
+			);
+		}
+		if(result == LIBDEFLATE_SUCCESS)
+			return true;
+		if(result != LIBDEFLATE_INSUFFICIENT_SPACE)
+			return false;
+		dst.resize(dst.size()*2);
+	}
+}
+
+LibdeflateCodec::LibdeflateCodec(uint8_t compression):
+	m_compression{compression}
+{
+	if(compression == MC::Compression::GZIP)
+		m_name = "libdeflate-gzip";
+	else
+		m_name = "libdeflate-zlib";
+}
+#endif
@@ -0,0 +1,82 @@
+#ifndef CODEC_HEADER
+#define CODEC_HEADER
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace MC {
+	// Compression type byte stored in front of every chunk in a region file
+	enum Compression : uint8_t {
+		GZIP = 1,
+		ZLIB = 2,
+		NONE = 3
+	};
+}
+
+// A decompression backend for one of the region file compression types.
+//  Codecs keep no per-call state, so one instance can be shared by any
+//  number of threads.
+class Codec
+{
+public:
+	virtual const char *name() const = 0;
+	// Decompresses src into dst, growing dst if it is too small.
+	//  On success, len holds the number of bytes written.
+	virtual bool decompress(
+		const uint8_t *src, size_t src_len, std::vector<uint8_t> &dst,
+		size_t &len
+	) const = 0;
+	virtual ~Codec();
+
+	// Returns the preferred backend for a compression type, or nullptr if
+	//  the type is unknown. libdeflate is preferred when built with
+	//  LIBDEFLATE=1, zlib otherwise.
+	static const Codec *get(uint8_t compression);
+	// Returns every backend built in for a compression type, preferred first
+	static std::vector<const Codec*> backends(uint8_t compression);
+};
+
+class ZlibCodec : public Codec
+{
+private:
+	int m_window_bits;
+	const char *m_name;
+public:
+	const char *name() const override;
+	bool decompress(
+		const uint8_t *src, size_t src_len, std::vector<uint8_t> &dst,
+		size_t &len
+	) const override;
+
+	ZlibCodec(uint8_t compression);
+};
+
+class StoredCodec : public Codec
+{
+public:
+	const char *name() const override;
+	bool decompress(
+		const uint8_t *src, size_t src_len, std::vector<uint8_t> &dst,
+		size_t &len
+	) const override;
+};
+
+#ifdef VOXELATOR_LIBDEFLATE
+class LibdeflateCodec : public Codec
+{
+private:
+	uint8_t m_compression;
+	const char *m_name;
+public:
+	const char *name() const override;
+	bool decompress(
+		const uint8_t *src, size_t src_len, std::vector<uint8_t> &dst,
+		size_t &len
+	) const override;
+
+	LibdeflateCodec(uint8_t compression);
+};
+#endif
+
+#endif
@@ -0,0 +1,145 @@
+#include <Edit/EditTracker.hpp>
+
+#include <algorithm>
+
+void EditTracker::Transaction::set_block(int x, int y, int z, uint8_t id) {
+	m_edits.push_back({x, y, z, id});
+}
+
+const std::vector<EditTracker::Edit> &EditTracker::Transaction::edits() const {
+	return m_edits;
+}
+
+bool EditTracker::Transaction::empty() const {
+	return m_edits.empty();
+}
+
+EditTracker::EditTracker(int chunks_x, int chunks_y, ChunkLookup lookup):
+	m_chunks_x{chunks_x},
+	m_chunks_y{chunks_y},
+	m_lookup{lookup},
+	m_dirty(chunks_x*chunks_y, Dirty{}),
+	m_edited(chunks_x*chunks_y, 0)
+{;}
+
+void EditTracker::mark_remesh(int cx, int cy, int s) {
+	if(cx < 0 || cy < 0 || cx >= m_chunks_x || cy >= m_chunks_y)
+		return;
+	if(s < 0 || s >= int(MC::Chunk::section_count))
+		return;
+	int index = cx*m_chunks_y + cy;
+	Dirty &dirty = m_dirty[index];
+	if(!dirty.sections)
+		m_remesh.push_back(index);
+	dirty.sections |= 1 << s;
+}
+
+bool EditTracker::set_block(int x, int y, int z, uint8_t id) {
+	Transaction transaction;
+	transaction.set_block(x, y, z, id);
+	return apply(transaction) != 0;
+}
+
+size_t EditTracker::apply(const Transaction &transaction) {
+	size_t changed = 0;
+	for(const Edit &edit : transaction.edits()) {
+		if(edit.x < 0 || edit.y < 0 || edit.z < 0 || edit.z >= 256)
+			continue;
+		int cx = edit.x/16;
+		int cy = edit.y/16;
+		if(cx >= m_chunks_x || cy >= m_chunks_y)
+			continue;
+		MC::Chunk *chunk = m_lookup(cx, cy);
+		if(!chunk)
+			continue;
+		int p[3] = {edit.x%16, edit.y%16, edit.z};
+		if(chunk->get(p[0], p[1], p[2]) == edit.id)
+			continue;
+		chunk->set(p[0], p[1], p[2], edit.id);
+		++changed;
+
+		int index = cx*m_chunks_y + cy;
+		int s = edit.z/16;
+		if(!m_edited[index])
+			m_edited_chunks.push_back(index);
+		m_edited[index] |= 1 << s;
+
+		Dirty &dirty = m_dirty[index];
+		if(!dirty.upload) {
+			m_upload.push_back(index);
+			dirty.upload = true;
+			for(int a=0;a<3;++a)
+				dirty.min[a] = dirty.max[a] = p[a];
+		}
+		for(int a=0;a<3;++a) {
+			dirty.min[a] = std::min(dirty.min[a], p[a]);
+			dirty.max[a] = std::max(dirty.max[a], p[a]);
+		}
+
+		mark_remesh(cx, cy, s);
+		if(p[0] == 0)
+			mark_remesh(cx-1, cy, s);
+		if(p[0] == 15)
+			mark_remesh(cx+1, cy, s);
+		if(p[1] == 0)
+			mark_remesh(cx, cy-1, s);
+		if(p[1] == 15)
+			mark_remesh(cx, cy+1, s);
+		if(p[2]%16 == 0)
+			mark_remesh(cx, cy, s-1);
+		if(p[2]%16 == 15)
+			mark_remesh(cx, cy, s+1);
+	}
+
+	// Share the edited sections again, once per section
+	for(int index : m_edited_chunks) {
+		MC::Chunk *chunk = m_lookup(index/m_chunks_y, index%m_chunks_y);
+		for(size_t s=0;s<MC::Chunk::section_count;++s) {
+			if(m_edited[index] >> s & 1)
+				chunk->finish_edit(s);
+		}
+		m_edited[index] = 0;
+	}
+	m_edited_chunks.clear();
+	return changed;
+}
+
+bool EditTracker::next_upload(int &x, int &y, int min[3], int max[3]) {
+	if(m_upload.empty())
+		return false;
+	int index = m_upload.front();
+	m_upload.pop_front();
+	Dirty &dirty = m_dirty[index];
+	x = index/m_chunks_y;
+	y = index%m_chunks_y;
+	for(int a=0;a<3;++a) {
+		min[a] = dirty.min[a];
+		max[a] = dirty.max[a];
+	}
+	dirty.upload = false;
+	return true;
+}
+
+bool EditTracker::next_remesh(int &x, int &y, uint16_t &sections) {
+	if(m_remesh.empty())
+		return false;
+	int index = m_remesh.front();
+	m_remesh.pop_front();
+	x = index/m_chunks_y;
+	y = index%m_chunks_y;
+	sections = m_dirty[index].sections;
+	m_dirty[index].sections = 0;
+	return true;
+}
+
+void EditTracker::defer_remesh(int x, int y, uint16_t sections) {
+	int index = x*m_chunks_y + y;
+	Dirty &dirty = m_dirty[index];
+	if(!dirty.sections)
+		m_remesh.push_front(index);
+	dirty.sections |= sections;
+}
+
+size_t EditTracker::pending_remeshes() const {
+	return m_remesh.size();
+}
@@ -0,0 +1,89 @@
+#ifndef EDIT_TRACKER_HEADER
+#define EDIT_TRACKER_HEADER
+
+#include <Storage/Chunk.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+// Applies block edits to the loaded chunks and remembers what has to be
+//  redone because of them: the box of voxels each chunk has to upload
+//  again, and the sections whose meshes are out of date. An edit on the
+//  border of a section also dirties the section next to it, in the same or
+//  the neighbouring chunk, as the faces between the two can change.
+//
+//  Chunks are numbered x*chunks_y + y like everywhere else, and positions
+//  are in blocks from the corner of chunk (0, 0). Work is handed out in the
+//  order it was first queued, so a caller with a time budget gets through
+//  all of it eventually.
+class EditTracker
+{
+public:
+	struct Edit {
+		int x;
+		int y;
+		int z;
+		uint8_t id;
+	};
+
+	// Edits that are applied together, so sections touched by several of
+	//  them are only finished and queued once
+	class Transaction
+	{
+	private:
+		std::vector<Edit> m_edits;
+	public:
+		void set_block(int x, int y, int z, uint8_t id);
+		const std::vector<Edit> &edits() const;
+		bool empty() const;
+	};
+
+	// Chunk at the given chunk coordinates, nullptr if it isn't loaded
+	using ChunkLookup = std::function<MC::Chunk*(int x, int y)>;
+
+private:
+	struct Dirty {
+		// Sections to remesh, bit s for sections[s]
+		uint16_t sections;
+		// Voxels to upload, both corners inclusive in chunk coordinates
+		bool upload;
+		int min[3];
+		int max[3];
+	};
+
+	int m_chunks_x;
+	int m_chunks_y;
+	ChunkLookup m_lookup;
+	std::vector<Dirty> m_dirty;
+	std::deque<int> m_remesh;
+	std::deque<int> m_upload;
+	// Sections edited by the transaction being applied, per chunk, and the
+	//  chunks with any
+	std::vector<uint16_t> m_edited;
+	std::vector<int> m_edited_chunks;
+
+	void mark_remesh(int cx, int cy, int s);
+public:
+	// Applies a single edit, true if it changed a voxel
+	bool set_block(int x, int y, int z, uint8_t id);
+	// Applies every edit of the transaction in order. Edits outside of the
+	//  loaded chunks or that don't change anything are skipped. Returns the
+	//  number of voxels changed.
+	size_t apply(const Transaction &transaction);
+
+	// Takes the next chunk whose voxels changed, with the box holding all of
+	//  them. False if there is none.
+	bool next_upload(int &x, int &y, int min[3], int max[3]);
+	// Takes the next chunk with sections to remesh. False if there is none.
+	bool next_remesh(int &x, int &y, uint16_t &sections);
+	// Puts sections taken by next_remesh back, to be taken first next time
+	void defer_remesh(int x, int y, uint16_t sections);
+	size_t pending_remeshes() const;
+
+	EditTracker(int chunks_x, int chunks_y, ChunkLookup lookup);
+};
+
+#endif
@@ -0,0 +1,192 @@
+#include <Jobs/JobSystem.hpp>
+
+#include <algorithm>
+
+namespace {
+	// Which system and queue the current thread works for, if any
+	thread_local JobSystem *t_system = nullptr;
+	thread_local size_t t_queue = 0;
+}
+
+bool TaskGroup::done() const {
+	return m_pending.load(std::memory_order_acquire) == 0;
+}
+
+TaskGroup::TaskGroup():
+	m_pending{0}
+{;}
+
+
+void JobSystem::run(TaskGroup &group, std::function<void()> fn) {
+	group.m_pending.fetch_add(1, std::memory_order_relaxed);
+	push({std::move(fn), &group});
+}
+
+void JobSystem::then(TaskGroup &dependency, TaskGroup &group, std::function<void()> fn) {
+	group.m_pending.fetch_add(1, std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lock(dependency.m_mutex);
+		if(dependency.m_pending.load(std::memory_order_acquire) != 0) {
+			dependency.m_continuations.push_back({&group, std::move(fn)});
+			return;
+		}
+	}
+	push({std::move(fn), &group});
+}
+
+void JobSystem::wait(TaskGroup &group) {
+	while(!group.done()) {
+		if(try_run_one())
+			continue;
+		// Nothing to help with, sleep until the group is done or there is
+		//  new work. finish() notifies once the group's count reaches zero.
+		std::unique_lock<std::mutex> lock(m_sleep_mutex);
+		m_sleep_cv.wait(lock, [this, &group] {
+			return group.done() || m_queued.load(std::memory_order_acquire) != 0;
+		});
+	}
+	// finish() may still hold the lock after the count reached zero, wait
+	//  for it so the group can safely be destroyed.
+	std::lock_guard<std::mutex> lock(group.m_mutex);
+}
+
+size_t JobSystem::worker_count() const {
+	return m_threads.size();
+}
+
+JobSystem &JobSystem::global() {
+	static JobSystem system;
+	return system;
+}
+
+void JobSystem::worker_main(size_t index) {
+	t_system = this;
+	t_queue = index;
+	while(m_running.load(std::memory_order_acquire)) {
+		if(try_run_one())
+			continue;
+		std::unique_lock<std::mutex> lock(m_sleep_mutex);
+		m_sleep_cv.wait(lock, [this] {
+			return m_queued.load(std::memory_order_acquire) != 0
+			    || !m_running.load(std::memory_order_acquire);
+		});
+	}
+}
+
+void JobSystem::push(Task task) {
+	WorkQueue &queue = *m_queues[current_queue()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+	// Counted under the sleep lock, so a thread that just found nothing
+	//  queued is already waiting when notified
+	{
+		std::lock_guard<std::mutex> lock(m_sleep_mutex);
+		m_queued.fetch_add(1, std::memory_order_release);
+	}
+	m_sleep_cv.notify_one();
+}
+
+bool JobSystem::pop(size_t index, Task &task) {
+	WorkQueue &queue = *m_queues[index];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if(queue.tasks.empty())
+		return false;
+	// Workers take their newest task, the injection queue is served in order
+	if(index+1 < m_queues.size()) {
+		task = std::move(queue.tasks.back());
+		queue.tasks.pop_back();
+	}
+	else {
+		task = std::move(queue.tasks.front());
+		queue.tasks.pop_front();
+	}
+	m_queued.fetch_sub(1, std::memory_order_relaxed);
+	return true;
+}
+
+bool JobSystem::steal(size_t thief, Task &task) {
+	size_t count = m_queues.size();
+	for(size_t i=1;i<count;++i) {
+		WorkQueue &queue = *m_queues[(thief+i)%count];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if(queue.tasks.empty())
+			continue;
+		task = std::move(queue.tasks.front());
+		queue.tasks.pop_front();
+		m_queued.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+	return false;
+}
+
+bool JobSystem::try_run_one() {
+	if(m_queued.load(std::memory_order_acquire) == 0)
+		return false;
+	size_t index = current_queue();
+	Task task;
+	if(pop(index, task) || steal(index, task)) {
+		execute(task);
+		return true;
+	}
+	return false;
+}
+
+void JobSystem::execute(Task &task) {
+	task.fn();
+	finish(*task.group);
+}
+
+void JobSystem::finish(TaskGroup &group) {
+	std::vector<TaskGroup::Continuation> continuations;
+	bool done = false;
+	{
+		std::lock_guard<std::mutex> lock(group.m_mutex);
+		if(group.m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			continuations.swap(group.m_continuations);
+			done = true;
+		}
+	}
+	// The group may be gone from here on, only touch the continuations
+	for(auto &c : continuations)
+		push({std::move(c.fn), c.group});
+	// Wakes the threads sleeping in wait. Taking the sleep lock makes sure
+	//  none of them is between checking done() and going to sleep.
+	if(done) {
+		{
+			std::lock_guard<std::mutex> lock(m_sleep_mutex);
+		}
+		m_sleep_cv.notify_all();
+	}
+}
+
+size_t JobSystem::current_queue() const {
+	if(t_system == this)
+		return t_queue;
+	return m_queues.size()-1;
+}
+
+JobSystem::JobSystem(size_t workers):
+	m_running{true},
+	m_queued{0}
+{
+	if(workers == 0) {
+		size_t hw = std::thread::hardware_concurrency();
+		workers = std::max<size_t>(1, hw > 1 ? hw-1 : 1);
+	}
+	for(size_t i=0;i<workers+1;++i)
+		m_queues.emplace_back(new WorkQueue);
+	for(size_t i=0;i<workers;++i)
+		m_threads.emplace_back([this, i]{ worker_main(i); });
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(m_sleep_mutex);
+		m_running.store(false, std::memory_order_release);
+	}
+	m_sleep_cv.notify_all();
+	for(auto &t : m_threads)
+		t.join();
+}
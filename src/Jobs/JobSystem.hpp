@@ -0,0 +1,125 @@
+#ifndef JOB_SYSTEM
+#define JOB_SYSTEM
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+
+// Counts the tasks submitted to it that haven't finished yet. Tasks queued
+//  with JobSystem::then run once every task of the group has finished, and
+//  count towards the group they are submitted to.
+class TaskGroup
+{
+private:
+	friend class JobSystem;
+	struct Continuation {
+		TaskGroup *group;
+		std::function<void()> fn;
+	};
+	std::atomic<size_t> m_pending;
+	std::mutex m_mutex;
+	std::vector<Continuation> m_continuations;
+public:
+	bool done() const;
+
+	TaskGroup();
+	TaskGroup(const TaskGroup&) = delete;
+	TaskGroup &operator=(const TaskGroup&) = delete;
+};
+
+// Work-stealing task scheduler. Every worker owns a deque: it pushes and
+//  pops its own tasks at the back (newest first, which keeps split ranges
+//  cache-hot) while idle workers steal from the front of other deques
+//  (oldest first, which tends to be the largest piece of work left).
+//  Threads that aren't workers submit through a shared injection deque and
+//  help executing tasks while they wait.
+class JobSystem
+{
+private:
+	struct Task {
+		std::function<void()> fn;
+		TaskGroup *group;
+	};
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	// One queue per worker, followed by the injection queue
+	std::vector<std::unique_ptr<WorkQueue>> m_queues;
+	std::vector<std::thread> m_threads;
+	std::atomic<bool> m_running;
+	std::atomic<size_t> m_queued;
+	// Idle workers and threads in wait sleep here. m_queued and
+	//  m_running change and groups finish under the mutex.
+	std::mutex m_sleep_mutex;
+	std::condition_variable m_sleep_cv;
+
+	void worker_main(size_t index);
+	void push(Task task);
+	bool pop(size_t index, Task &task);
+	bool steal(size_t thief, Task &task);
+	bool try_run_one();
+	void execute(Task &task);
+	void finish(TaskGroup &group);
+	size_t current_queue() const;
+
+	template<typename F>
+	void split(TaskGroup &group, size_t begin, size_t end, size_t grain, const F &f);
+public:
+	// Runs fn on some worker as part of group
+	void run(TaskGroup &group, std::function<void()> fn);
+	// Runs fn as part of group once every task of dependency has finished
+	void then(TaskGroup &dependency, TaskGroup &group, std::function<void()> fn);
+	// Blocks until group is done, executing tasks in the meantime
+	void wait(TaskGroup &group);
+	// Calls f(i) for every i in [begin, end). The range is split in halves
+	//  down to grain iterations, so idle workers can steal large pieces.
+	template<typename F>
+	void parallel_for(size_t begin, size_t end, size_t grain, const F &f);
+
+	size_t worker_count() const;
+
+	// Shared instance using all hardware threads
+	static JobSystem &global();
+
+	// workers == 0 uses one worker per hardware thread, minus the caller
+	JobSystem(size_t workers = 0);
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem &operator=(const JobSystem&) = delete;
+};
+
+template<typename F>
+void JobSystem::split(TaskGroup &group, size_t begin, size_t end, size_t grain, const F &f) {
+	while(end - begin > grain) {
+		size_t mid = begin + (end - begin)/2;
+		run(group, [this, &group, mid, end, grain, &f] {
+			split(group, mid, end, grain, f);
+		});
+		end = mid;
+	}
+	for(size_t i=begin;i<end;++i)
+		f(i);
+}
+
+template<typename F>
+void JobSystem::parallel_for(size_t begin, size_t end, size_t grain, const F &f) {
+	if(begin >= end)
+		return;
+	if(grain == 0)
+		grain = 1;
+	TaskGroup group;
+	split(group, begin, end, grain, f);
+	wait(group);
+}
+
+#endif
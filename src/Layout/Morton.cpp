@@ -0,0 +1,34 @@
+#include <Layout/Morton.hpp>
+
+#include <cstring>
+
+namespace {
+	// Eight consecutive codes are one 2x2x2 brick, which sits at these
+	//  offsets from its lowest corner in linear order.
+	const size_t brick_offsets[8] = {0, 1, 16, 17, 256, 257, 272, 273};
+
+	// Linear offset of the lowest corner of brick b, b = code>>3
+	size_t brick_base(uint32_t b) {
+		uint32_t x, y, z;
+		Morton::decode(b<<3, x, y, z);
+		return z*16*16 + y*16 + x;
+	}
+}
+
+void Morton::to_linear(const uint8_t *morton, uint8_t *linear) {
+	for(uint32_t b=0;b<512;++b) {
+		uint8_t *out = linear + brick_base(b);
+		const uint8_t *in = morton + 8*b;
+		for(int i=0;i<8;++i)
+			out[brick_offsets[i]] = in[i];
+	}
+}
+
+void Morton::from_linear(const uint8_t *linear, uint8_t *morton) {
+	for(uint32_t b=0;b<512;++b) {
+		const uint8_t *in = linear + brick_base(b);
+		uint8_t *out = morton + 8*b;
+		for(int i=0;i<8;++i)
+			out[i] = in[brick_offsets[i]];
+	}
+}
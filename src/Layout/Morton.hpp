@@ -0,0 +1,59 @@
+#ifndef MORTON_HEADER
+#define MORTON_HEADER
+
+#include <cstddef>
+#include <cstdint>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+// Z-order curve over a 16x16x16 section. Bit i of x, y and z ends up at
+//  bit 3*i, 3*i+1 and 3*i+2 of the code, so every aligned 2x2x2, 4x4x4 and
+//  8x8x8 block of voxels is contiguous.
+namespace Morton {
+	constexpr uint32_t mask_x = 0x249;
+	constexpr uint32_t mask_y = 0x492;
+	constexpr uint32_t mask_z = 0x924;
+
+	// Moves the low 4 bits of v to bits 0, 3, 6 and 9
+	inline uint32_t spread(uint32_t v) {
+		v = (v | (v<<4)) & 0x0C3;
+		v = (v | (v<<2)) & 0x249;
+		return v;
+	}
+	// Inverse of spread, ignores all other bits
+	inline uint32_t compact(uint32_t v) {
+		v &= 0x249;
+		v = (v | (v>>2)) & 0x0C3;
+		v = (v | (v>>4)) & 0x00F;
+		return v;
+	}
+
+	// x, y and z must be below 16
+	inline uint32_t encode(uint32_t x, uint32_t y, uint32_t z) {
+#ifdef __BMI2__
+		return _pdep_u32(x, mask_x) | _pdep_u32(y, mask_y) | _pdep_u32(z, mask_z);
+#else
+		return spread(x) | (spread(y)<<1) | (spread(z)<<2);
+#endif
+	}
+
+	inline void decode(uint32_t code, uint32_t &x, uint32_t &y, uint32_t &z) {
+#ifdef __BMI2__
+		x = _pext_u32(code, mask_x);
+		y = _pext_u32(code, mask_y);
+		z = _pext_u32(code, mask_z);
+#else
+		x = compact(code);
+		y = compact(code>>1);
+		z = compact(code>>2);
+#endif
+	}
+
+	// Converts one section between Morton order and the linear
+	//  z*16*16 + y*16 + x order
+	void to_linear(const uint8_t *morton, uint8_t *linear);
+	void from_linear(const uint8_t *linear, uint8_t *morton);
+}
+
+#endif
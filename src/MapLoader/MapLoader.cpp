@@ -3,7 +3,8 @@
 #include <fstream>
 #include <iostream>
 #include <cmath>
-#include <zlib.h>
+#include <algorithm>
+#include <Codec/Codec.hpp>
 #include <NBTParser/NBTParser.hpp>
 
 template<typename T>
@@ -15,119 +16,231 @@ T invert_endian(T a) {
 	return result;
 }
 
-void MapLoader::load(std::string filename, int offsetx, int offsety) {
-	// if(offsetx+1>regions.size())
-		regions.resize(10);
-	// if(offsety+1>regions[0].size()) {
-		for(auto &chunk : regions) {
-			chunk.resize(10);
-		}
-	// }
+void MapLoader::load(std::string filename, int offsetx, int offsety, JobSystem &jobs) {
+	reserve(offsetx, offsety);
+
+	MC::Region &region = regions[offsetx][offsety];
+	std::vector<MC::RawChunk> raw_chunks;
+	if(!read_region(filename, region, raw_chunks))
+		return;
+
+	unsigned int max=0;
+	for(int i=0;i<1024;++i) {
+		if(region.times.times[i] > max)
+			max = region.times.times[i];
+	}
+	std::cout<<"Largest timestamp was "<<max<<std::endl;
+
+	max = 0;
+	for(int i=0;i<1024;++i) {
+		max = std::max((region.locations.table[i].offset)+(region.locations.table[i].size), max);
+	}
+	std::cout<<"Filesize was "<<max<<std::endl;
 
+	jobs.parallel_for(0, raw_chunks.size(), 4, [&](size_t i) {
+		static thread_local std::vector<uint8_t> uncompressed_data(4*1024*1024);
+		load_chunk(raw_chunks[i], uncompressed_data, region.chunks[raw_chunks[i].index], storage);
+	});
+}
+
+void MapLoader::reserve(int x, int y) {
+	size_t size_x = std::max<size_t>(std::max<size_t>(regions.size(), 10), x+1);
+	size_t size_y = std::max<size_t>(10, y+1);
+	if(!regions.empty())
+		size_y = std::max(size_y, regions[0].size());
+	regions.resize(size_x);
+	for(auto &row : regions) {
+		row.resize(size_y);
+	}
+}
+
+bool MapLoader::read_region(
+	std::string filename, MC::Region &region,
+	std::vector<MC::RawChunk> &raw_chunks
+) {
 	std::ifstream file(filename, std::ios::binary | std::ios::in);
 	if(!file.is_open())
-		return;
+		return false;
+	if(!read_region_header(file, region))
+		return false;
+
+	raw_chunks.clear();
+	for(uint32_t i=0;i<1024;++i) {
+		MC::RawChunk raw;
+		if(read_raw_chunk(file, region.locations.table[i], i, raw))
+			raw_chunks.push_back(std::move(raw));
+	}
+
+	file.close();
+	return true;
+}
+
+bool MapLoader::load_chunk(
+	const MC::RawChunk &raw, std::vector<uint8_t> &scratch, MC::Chunk &chunk,
+	MC::Storage storage
+) {
+	chunk.loaded = false;
+
+	size_t len;
+	if(!inflate_chunk(raw, scratch, len))
+		return false;
+
+	std::vector<MC::RawSection> sections;
+	if(!parse_chunk(scratch.data(), len, sections))
+		return false;
+
+	transpose_chunk(sections, chunk, storage);
+	return true;
+}
+
+bool MapLoader::read_region_header(std::ifstream &file, MC::Region &region) {
+	for(int i=0;i<1024;++i)
+		region.chunks[i].loaded=false;
+
 	// Parse Location Table
 	for(int loc=0;loc<1024;++loc) {
 		int tmp;
 		file.read(reinterpret_cast<char*>(&tmp), 4);
-		regions[offsetx][offsety].locations.table[loc].size = (tmp>>24)*4096;
-		regions[offsetx][offsety].locations.table[loc].offset = (invert_endian(tmp&0xFFFFFF)>>8)*4096;
+		region.locations.table[loc].size = (tmp>>24)*4096;
+		region.locations.table[loc].offset = (invert_endian(tmp&0xFFFFFF)>>8)*4096;
 	}
 	// Parse Timestamp Table
 	for(int t=0;t<1024;++t) {
 		int tmp;
 		file.read(reinterpret_cast<char*>(&tmp), 4);
 		tmp = invert_endian(tmp);
-		regions[offsetx][offsety].times.times[t] = tmp;
+		region.times.times[t] = tmp;
 	}
+	return file.good();
+}
 
-	unsigned int max=0;
-	for(int i=0;i<1024;++i) {
-		if(regions[offsetx][offsety].times.times[i] > max)
-			max = regions[offsetx][offsety].times.times[i];
+bool MapLoader::read_raw_chunk(
+	std::ifstream &file, const MC::Location &location, uint32_t index,
+	MC::RawChunk &raw
+) {
+	if(location.offset == 0)
+		return false;
+	// The length field and compression byte alone take 5 bytes
+	if(location.size < 5)
+		return false;
+
+	// Every chunk starts with its big endian length (including the
+	//  compression byte) followed by the compression type.
+	uint8_t header[5];
+	file.seekg(location.offset);
+	file.read(reinterpret_cast<char*>(header), 5);
+	if(!file.good()) {
+		file.clear();
+		return false;
 	}
-	std::cout<<"Largest timestamp was "<<max<<std::endl;
+	uint32_t length = invert_endian(*reinterpret_cast<uint32_t*>(header));
+	// Lengths are untrusted: compared without adding to them, so one near
+	//  UINT32_MAX can't wrap around and pass, and never beyond the sectors
+	//  the location table gives the chunk
+	if(length == 0 || length > location.size-4)
+		return false;
+
+	raw.index = index;
+	raw.compression = header[4];
+	raw.data.resize(length-1);
+	file.read(reinterpret_cast<char*>(raw.data.data()), length-1);
+	if(!file.good()) {
+		file.clear();
+		return false;
+	}
+	return true;
+}
 
-	max = 0;
-	for(int i=0;i<1024;++i) {
-		max = std::max((regions[offsetx][offsety].locations.table[i].offset)+(regions[offsetx][offsety].locations.table[i].size), max);
+bool MapLoader::inflate_chunk(
+	const MC::RawChunk &raw, std::vector<uint8_t> &out, size_t &len
+) {
+	const Codec *codec = Codec::get(raw.compression);
+	if(!codec) {
+		// Chunks with bit 128 set live in a separate .mcc file, which we
+		//  don't support yet.
+		std::cout<<"Skipping chunk "<<raw.index<<" with unsupported compression "
+			<<static_cast<int>(raw.compression)<<std::endl;
+		return false;
 	}
-	std::cout<<"Filesize was "<<max<<std::endl;
+	return codec->decompress(raw.data.data(), raw.data.size(), out, len);
+}
 
-	std::vector<uint8_t> compressed_data(4*1024*1024);
-	std::vector<uint8_t> uncompressed_data(4*1024*1024);
+bool MapLoader::parse_chunk(
+	uint8_t *data, size_t len, std::vector<MC::RawSection> &sections
+) {
+	std::shared_ptr<Tags::List> section_tags;
+	try {
+		auto tag = parse_nbt(data, len, 0);
+		if(tag->data.empty())
+			return false;
+		std::shared_ptr<Tags::Compound> level = std::static_pointer_cast<Tags::Compound>(tag->data[0]);
+		section_tags = std::static_pointer_cast<Tags::List>((*level)["Sections"]);
+	} catch(int e) {
+		return false;
+	}
 
-	for(int i=0;i<1024;++i) {
-		regions[offsetx][offsety].chunks[i].loaded=false;
-		if(regions[offsetx][offsety].locations.table[i].offset == 0)
+	sections.clear();
+	for(auto &t : section_tags->data) {
+		std::shared_ptr<Tags::Compound> section = std::static_pointer_cast<Tags::Compound>(t);
+		uint32_t y;
+		std::vector<Tags::Byte> *blocks;
+		try {
+			y = static_cast<uint32_t>(std::static_pointer_cast<Tags::Byte>((*section)["Y"])->data);
+			blocks = &(std::static_pointer_cast<Tags::Byte_Array>((*section)["Blocks"])->data);
+		} catch (int e) {
 			continue;
-		if(regions[offsetx][offsety].locations.table[i].size == 0)
+		}
+		if(y > 15 || blocks->size() < 16*16*16)
 			continue;
-		// chunks[i].data.resize(locations.table[i].size);
-		file.seekg(regions[offsetx][offsety].locations.table[i].offset);
-		file.read(reinterpret_cast<char*>(compressed_data.data()), regions[offsetx][offsety].locations.table[i].size);
-
-		uint32_t length = invert_endian(*reinterpret_cast<uint32_t*>(compressed_data.data()));
-		uint8_t  compression = compressed_data[4];
-		if(compression == 2) {
-			uLongf len = uncompressed_data.size();
-			uncompress(
-				uncompressed_data.data(),
-				&len,
-				const_cast<const uint8_t*>(&(compressed_data[5])),
-				length-1
-			);
-			auto tag = parse_nbt(uncompressed_data.data(), len, 0);
-
-			std::shared_ptr<Tags::Compound> level = std::static_pointer_cast<Tags::Compound>(tag->data[0]);
-			std::shared_ptr<Tags::List> sections;
-
-
-			try {
-				sections = std::static_pointer_cast<Tags::List>((*level)["Sections"]);
-			} catch(int e) {
-				continue;
-			}
-			
-			regions[offsetx][offsety].chunks[i].blocks.resize(16*16*256);
-			for(auto &block : regions[offsetx][offsety].chunks[i].blocks)
-				block = 0;
-			regions[offsetx][offsety].chunks[i].loaded = true;
-
-			for(auto &t : sections->data) {
-				std::shared_ptr<Tags::Compound> section = std::static_pointer_cast<Tags::Compound>(t);
-				uint32_t y;
-				std::vector<Tags::Byte> *blocks;
-				try {
-					y = static_cast<uint32_t>(std::static_pointer_cast<Tags::Byte>((*section)["Y"])->data);
-					blocks = &(std::static_pointer_cast<Tags::Byte_Array>((*section)["Blocks"])->data);
-				} catch (int e) {
-					continue;
-				}
 
-				size_t offset = ((15-y)*16*16*16);
+		MC::RawSection raw;
+		raw.y = y;
+		raw.blocks.resize(16*16*16);
+		for(size_t i=0;i<raw.blocks.size();++i)
+			raw.blocks[i] = (*blocks)[i].data;
+		sections.push_back(std::move(raw));
+	}
+	return true;
+}
 
-				for(uint32_t _z=0;_z<16;++_z) {
-					for(uint32_t _y=0;_y<16;++_y) {
-						for(uint32_t _x=0;_x<16;++_x) {
-							size_t index_vox = offset+((15-_y)*16*16+_z*16+_x);
-							size_t index_mca = _y*16*16+_z*16+_x;
-								regions[offsetx][offsety].chunks[i].blocks[index_vox] = (*blocks)[index_mca].data;
-						}
-					}
+void MapLoader::transpose_chunk(
+	const std::vector<MC::RawSection> &sections, MC::Chunk &chunk,
+	MC::Storage storage
+) {
+	// Sections missing from the file are air
+	static thread_local VoxelBuffer voxels(MC::Chunk::size);
+	std::fill(voxels.begin(), voxels.end(), 0);
+
+	// Minecraft sections are stored bottom up in YZX order, ours top down
+	//  in ZYX order with z pointing down.
+	for(auto &section : sections) {
+		uint8_t *transposed = voxels.data() + (15-section.y)*SectionData::size;
+		for(uint32_t _z=0;_z<16;++_z) {
+			for(uint32_t _y=0;_y<16;++_y) {
+				for(uint32_t _x=0;_x<16;++_x) {
+					size_t index_vox = (15-_y)*16*16+_z*16+_x;
+					size_t index_mca = _y*16*16+_z*16+_x;
+					transposed[index_vox] = section.blocks[index_mca];
 				}
 			}
-			// chunks[i].data.clear();
 		}
 	}
-	uncompressed_data.clear();
-	compressed_data.clear();
 
-	file.close();
+	if(storage == MC::Storage::COLUMN_RLE) {
+		for(auto &handle : chunk.sections)
+			handle = SectionHandle();
+		chunk.rle.encode(voxels.data());
+		chunk.storage = MC::Storage::COLUMN_RLE;
+	}
+	else {
+		chunk.assign(voxels.data());
+	}
+	chunk.loaded = true;
 }
 
-MapLoader::MapLoader() {
+MapLoader::MapLoader():
+	storage{MC::Storage::SECTIONS}
+{
 
 }
 
@@ -2,8 +2,12 @@
 #define MAP_LOADER
 
 #include <string>
+#include <fstream>
 #include <vector>
 #include <memory>
+#include <Jobs/JobSystem.hpp>
+#include <Allocator/SlabAllocator.hpp>
+#include <Storage/Chunk.hpp>
 
 namespace MC {
 	struct Location {
@@ -16,9 +20,16 @@ namespace MC {
 	struct TimestampTable {
 		uint32_t times[1024];
 	};
-	struct Chunk {
-		std::vector<uint8_t> blocks;
-		bool loaded;
+	// A chunk exactly as stored in the region file, still compressed
+	struct RawChunk {
+		uint32_t index;
+		uint8_t compression;
+		std::vector<uint8_t> data;
+	};
+	// One 16x16x16 section as stored in the NBT data, in Minecraft's YZX order
+	struct RawSection {
+		uint32_t y;
+		VoxelBuffer blocks;
 	};
 	struct Region {
 		MC::LocationTable locations;
@@ -31,7 +42,45 @@ class MapLoader
 {
 public:
 	std::vector<std::vector<MC::Region>> regions;
-	void load(std::string filename, int offset_x, int offset_y);
+	// How loaded chunks keep their voxels, applied by load() and LoadPipeline
+	MC::Storage storage;
+	// Loads a region file into regions[offset_x][offset_y], decoding its
+	//  chunks in parallel on jobs.
+	void load(
+		std::string filename, int offset_x, int offset_y,
+		JobSystem &jobs = JobSystem::global()
+	);
+	// Grows regions so that regions[x][y] exists
+	void reserve(int x, int y);
+	// Reads the location and timestamp tables of a region file, along with
+	//  the compressed payload of every chunk present in it.
+	static bool read_region(
+		std::string filename, MC::Region &region,
+		std::vector<MC::RawChunk> &raw_chunks
+	);
+	// Decompresses, parses and transposes a single chunk into our layout.
+	//  scratch holds the decompressed NBT and is reused between calls.
+	static bool load_chunk(
+		const MC::RawChunk &raw, std::vector<uint8_t> &scratch,
+		MC::Chunk &chunk, MC::Storage storage = MC::Storage::SECTIONS
+	);
+
+	// The individual steps of loading, used by load() and LoadPipeline
+	static bool read_region_header(std::ifstream &file, MC::Region &region);
+	static bool read_raw_chunk(
+		std::ifstream &file, const MC::Location &location, uint32_t index,
+		MC::RawChunk &raw
+	);
+	static bool inflate_chunk(
+		const MC::RawChunk &raw, std::vector<uint8_t> &out, size_t &len
+	);
+	static bool parse_chunk(
+		uint8_t *data, size_t len, std::vector<MC::RawSection> &sections
+	);
+	static void transpose_chunk(
+		const std::vector<MC::RawSection> &sections, MC::Chunk &chunk,
+		MC::Storage storage = MC::Storage::SECTIONS
+	);
 	MapLoader();
 	~MapLoader();
 };
@@ -0,0 +1,317 @@
+#include <MeshCache/MeshCache.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	const char file_magic[4] = {'V', 'X', 'M', 'C'};
+	const uint32_t file_version = 2;
+
+	struct Header {
+		char magic[4];
+		uint32_t file_version;
+		uint64_t mesher_id;
+		uint64_t records;
+		uint64_t quads;
+	};
+
+	// Same multiply-rotate hash as SectionStore::hash, over whole words.
+	//  Two of them with different seeds make up a Key.
+	const uint64_t prime0 = 0x9E3779B185EBCA87ull;
+	const uint64_t prime1 = 0xC2B2AE3D27D4EB4Full;
+
+	uint64_t mix(uint64_t h, uint64_t word) {
+		word *= prime1;
+		word = (word<<31) | (word>>33);
+		h ^= word*prime0;
+		return ((h<<27) | (h>>37))*prime0 + prime1;
+	}
+
+	uint64_t mix(uint64_t h, const uint8_t *data, size_t size) {
+		for(size_t i=0;i<size;i+=8) {
+			uint64_t word = 0;
+			std::memcpy(&word, data+i, std::min<size_t>(8, size-i));
+			h = mix(h, word);
+		}
+		return h;
+	}
+
+	uint64_t finish(uint64_t h) {
+		h ^= h>>33;
+		h *= prime1;
+		h ^= h>>29;
+		return h;
+	}
+}
+
+MeshCache::MeshCache():
+	m_mapping{nullptr},
+	m_mapping_size{0},
+	m_mapped_records{nullptr},
+	m_mapped_quads{nullptr},
+	m_mapped_quad_count{0},
+	m_hits{0},
+	m_misses{0},
+	m_mesher_id{0}
+{;}
+
+MeshCache::~MeshCache() {
+	close();
+}
+
+void MeshCache::close() {
+#ifndef _WIN32
+	if(m_mapping && m_file_contents.empty())
+		munmap(const_cast<uint8_t*>(m_mapping), m_mapping_size);
+#endif
+	m_mapping = nullptr;
+	m_mapping_size = 0;
+	m_file_contents.clear();
+	m_mapped_records = nullptr;
+	m_mapped_quads = nullptr;
+	m_mapped_quad_count = 0;
+	m_mapped_used.clear();
+	m_index.clear();
+	m_stored_records.clear();
+	m_stored_quads.clear();
+}
+
+MeshCache::Key MeshCache::key(const PaddedChunk &voxels, bool skip_bottom) {
+	// Meshes only depend on the voxels of the chunk and the border voxels
+	//  sharing a face with them. The layers below and above the chunk are
+	//  always air and the corners of the border are never looked at, so
+	//  each layer is the rows y=0..15 with their x borders in one piece
+	//  plus the y borders of x=0..15.
+	static_assert(PaddedChunk::size_x*16%8 == 0 && 16%8 == 0, "hashed in whole words");
+	uint64_t seed = uint64_t(skip_bottom ? 1 : 0)*prime0;
+	Key key{prime1 ^ seed, prime0 ^ ~seed};
+	const uint8_t *data = voxels.data();
+	const size_t rows = PaddedChunk::size_x*16;
+	for(int z=0;z<256;++z) {
+		const uint8_t *spans[3] = {
+			data + PaddedChunk::index(-1, 0, z),
+			data + PaddedChunk::index(0, -1, z),
+			data + PaddedChunk::index(0, 16, z)
+		};
+		const size_t sizes[3] = {rows, 16, 16};
+		for(int i=0;i<3;++i) {
+			for(size_t j=0;j<sizes[i];j+=8) {
+				uint64_t word;
+				std::memcpy(&word, spans[i]+j, 8);
+				key.hash = mix(key.hash, word);
+				key.check = mix(key.check, word ^ prime1);
+			}
+		}
+	}
+	key.hash = finish(key.hash);
+	key.check = finish(key.check*prime0);
+	return key;
+}
+
+uint64_t MeshCache::mesher_id(const std::string &backend, const std::vector<std::string> &sources) {
+	uint64_t h = mix(prime1, Mesher::version);
+	h = mix(mix(h, backend.size()), reinterpret_cast<const uint8_t*>(backend.data()), backend.size());
+	for(auto &source : sources)
+		h = mix(mix(h, source.size()), reinterpret_cast<const uint8_t*>(source.data()), source.size());
+	return finish(h);
+}
+
+uint64_t MeshCache::record_quads(const Record &record) {
+	uint64_t quads = 0;
+	for(int n=0;n<Mesher::directions;++n) {
+		for(int s=0;s<Mesher::sections;++s)
+			quads += record.range_quads[n][s];
+	}
+	return quads;
+}
+
+const MeshCache::Record &MeshCache::record_at(const Location &location) const {
+	return location.mapped ? m_mapped_records[location.record] : m_stored_records[location.record];
+}
+
+bool MeshCache::open(const std::string &filename, uint64_t mesher_id) {
+	close();
+	m_mesher_id = mesher_id;
+#ifdef _WIN32
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if(!file)
+		return false;
+	m_file_contents.resize(file.tellg());
+	file.seekg(0);
+	if(!file.read(reinterpret_cast<char*>(m_file_contents.data()), m_file_contents.size())) {
+		m_file_contents.clear();
+		return false;
+	}
+	m_mapping = m_file_contents.data();
+	m_mapping_size = m_file_contents.size();
+#else
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if(fd < 0)
+		return false;
+	struct stat info;
+	if(fstat(fd, &info) || info.st_size < static_cast<off_t>(sizeof(Header))) {
+		::close(fd);
+		return false;
+	}
+	void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(mapping == MAP_FAILED)
+		return false;
+	m_mapping = static_cast<const uint8_t*>(mapping);
+	m_mapping_size = info.st_size;
+#endif
+
+	// Everything in the file is checked against its size before use
+	Header header;
+	size_t quads_offset = 0;
+	bool valid = m_mapping_size >= sizeof(header);
+	if(valid) {
+		std::memcpy(&header, m_mapping, sizeof(header));
+		valid = !std::memcmp(header.magic, file_magic, sizeof(file_magic))
+			&& header.file_version == file_version
+			&& header.mesher_id == mesher_id
+			&& header.records <= (m_mapping_size-sizeof(header))/sizeof(Record);
+		quads_offset = sizeof(header) + sizeof(Record)*size_t(valid ? header.records : 0);
+		valid = valid && quads_offset <= m_mapping_size
+			&& header.quads <= (m_mapping_size-quads_offset)/sizeof(Mesher::Quad);
+	}
+	if(!valid) {
+		close();
+		return false;
+	}
+	m_mapped_records = reinterpret_cast<const Record*>(m_mapping + sizeof(header));
+	m_mapped_quads = reinterpret_cast<const Mesher::Quad*>(m_mapping + quads_offset);
+	m_mapped_quad_count = header.quads;
+	m_mapped_used.assign(header.records, false);
+	// Records are checked against the file when they're looked up
+	for(size_t r=0;r<header.records;++r)
+		m_index[m_mapped_records[r].key] = Location{true, r};
+	return true;
+}
+
+bool MeshCache::find(const Key &key, Entry &entry) {
+	auto it = m_index.find(key.hash);
+	if(it == m_index.end()) {
+		++m_misses;
+		return false;
+	}
+	const Location &location = it->second;
+	const Record &found = record_at(location);
+	uint64_t quads = record_quads(found);
+	bool valid = found.check == key.check;
+	if(location.mapped) {
+		valid = valid && found.first_quad <= m_mapped_quad_count
+			&& quads <= m_mapped_quad_count-found.first_quad
+			&& quads <= UINT32_MAX;
+	}
+	// A colliding or damaged entry is dropped, store replaces it
+	if(!valid) {
+		m_index.erase(it);
+		++m_misses;
+		return false;
+	}
+	++m_hits;
+	if(location.mapped) {
+		m_mapped_used[location.record] = true;
+		entry.quads = m_mapped_quads + found.first_quad;
+	}
+	else
+		entry.quads = m_stored_quads.data() + found.first_quad;
+	entry.quad_count = quads;
+	entry.range_quads = found.range_quads;
+	return true;
+}
+
+void MeshCache::store(
+	const Key &key, const Mesher::Quad *quads, size_t quad_count,
+	const uint32_t range_quads[Mesher::directions][Mesher::sections]
+) {
+	// Equal keys have equal meshes, identical chunks are stored once
+	auto it = m_index.find(key.hash);
+	if(it != m_index.end() && record_at(it->second).check == key.check)
+		return;
+	Record record;
+	record.key = key.hash;
+	record.check = key.check;
+	record.first_quad = m_stored_quads.size();
+	std::memcpy(record.range_quads, range_quads, sizeof(record.range_quads));
+	m_index[key.hash] = Location{false, m_stored_records.size()};
+	m_stored_records.push_back(record);
+	m_stored_quads.insert(m_stored_quads.end(), quads, quads+quad_count);
+}
+
+bool MeshCache::save(const std::string &filename) const {
+	// Entries that were replaced by store are left out with the unused
+	//  ones, only what m_index points at is live
+	std::vector<Record> records;
+	std::vector<const Mesher::Quad*> sources;
+	uint64_t quads = 0;
+	for(auto &it : m_index) {
+		const Location &location = it.second;
+		if(location.mapped && !m_mapped_used[location.record])
+			continue;
+		Record record = record_at(location);
+		sources.push_back(
+			(location.mapped ? m_mapped_quads : m_stored_quads.data()) + record.first_quad
+		);
+		record.first_quad = quads;
+		quads += record_quads(record);
+		records.push_back(record);
+	}
+
+	std::string temporary = filename + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::out | std::ios::trunc);
+		if(!file)
+			return false;
+		Header header;
+		std::memcpy(header.magic, file_magic, sizeof(file_magic));
+		header.file_version = file_version;
+		header.mesher_id = m_mesher_id;
+		header.records = records.size();
+		header.quads = quads;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(records.data()), sizeof(Record)*records.size());
+		for(size_t r=0;r<records.size();++r) {
+			file.write(
+				reinterpret_cast<const char*>(sources[r]),
+				sizeof(Mesher::Quad)*record_quads(records[r])
+			);
+		}
+		if(!file)
+			return false;
+	}
+	// The old file may still be mapped, which keeps its contents alive
+	std::remove(filename.c_str());
+	return !std::rename(temporary.c_str(), filename.c_str());
+}
+
+bool MeshCache::modified() const {
+	if(!m_stored_records.empty())
+		return true;
+	for(bool used : m_mapped_used) {
+		if(!used)
+			return true;
+	}
+	return false;
+}
+
+std::string MeshCache::report() const {
+	char line[256];
+	std::snprintf(
+		line, sizeof(line),
+		"Mesh cache: %llu hits, %llu misses, %zu stored meshes of %.1f KiB\n",
+		static_cast<unsigned long long>(m_hits),
+		static_cast<unsigned long long>(m_misses), m_stored_records.size(),
+		m_stored_quads.size()*sizeof(Mesher::Quad)/1024.0
+	);
+	return line;
+}
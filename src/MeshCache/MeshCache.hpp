@@ -0,0 +1,107 @@
+#ifndef MESH_CACHE_HEADER
+#define MESH_CACHE_HEADER
+
+#include <Mesher/Mesher.hpp>
+#include <Storage/PaddedChunk.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Chunk meshes saved between runs, so unchanged chunks don't have to be
+//  meshed again on every start. Entries are keyed by a hash of everything a
+//  chunk's mesh depends on: its voxels and the face-adjacent border of its
+//  neighbours, as held by a PaddedChunk, and skip_bottom. A second hash of
+//  the same voxels is kept with each entry and has to match as well. The
+//  file holds meshes of one mesher, identified by mesher_id, and is only
+//  used by that one.
+//
+//  The file is mapped into memory when opened and the quads of a hit are
+//  read straight from the mapping, e.g. into a buffer upload. Meshes of
+//  misses are added with store. save writes every entry that was found or
+//  stored since opening, so entries of chunks that changed or went away
+//  are dropped.
+class MeshCache
+{
+public:
+	struct Key {
+		uint64_t hash;
+		// Independent of hash, tells apart chunks whose hashes collide
+		uint64_t check;
+	};
+	struct Entry {
+		const Mesher::Quad *quads;
+		uint32_t quad_count;
+		// Counts of each direction and section, like Mesher::Stats
+		const uint32_t (*range_quads)[Mesher::sections];
+	};
+
+private:
+	// On disk layout of an entry, followed in the file by all quads
+	struct Record {
+		uint64_t key;
+		uint64_t check;
+		uint64_t first_quad;
+		uint32_t range_quads[Mesher::directions][Mesher::sections];
+	};
+	struct Location {
+		bool mapped;
+		size_t record;
+	};
+
+	// The mapped file, or its contents where mapping isn't available
+	const uint8_t *m_mapping;
+	size_t m_mapping_size;
+	std::vector<uint8_t> m_file_contents;
+	const Record *m_mapped_records;
+	const Mesher::Quad *m_mapped_quads;
+	uint64_t m_mapped_quad_count;
+	std::vector<bool> m_mapped_used;
+
+	std::vector<Record> m_stored_records;
+	std::vector<Mesher::Quad> m_stored_quads;
+	std::unordered_map<uint64_t, Location> m_index;
+	uint64_t m_hits;
+	uint64_t m_misses;
+
+	uint64_t m_mesher_id;
+
+	static uint64_t record_quads(const Record &record);
+	const Record &record_at(const Location &location) const;
+public:
+	static Key key(const PaddedChunk &voxels, bool skip_bottom);
+	// Identifies the mesher by its name, e.g. "cpu", the source of the
+	//  shaders it runs and Mesher::version
+	static uint64_t mesher_id(const std::string &backend, const std::vector<std::string> &sources);
+
+	// Maps the cache file. False if it is missing or not a cache of this
+	//  mesher, the cache then starts out empty.
+	bool open(const std::string &filename, uint64_t mesher_id);
+	// Unmaps the file and forgets every entry
+	void close();
+	// Looks up a mesh, the entry stays valid as long as the cache is open.
+	//  Entries that don't match key.check or don't fit in the file are
+	//  misses.
+	bool find(const Key &key, Entry &entry);
+	// Adds a mesh, unless there already is one with the same key
+	void store(
+		const Key &key, const Mesher::Quad *quads, size_t quad_count,
+		const uint32_t range_quads[Mesher::directions][Mesher::sections]
+	);
+	// Writes the entries found or stored since open. The file is replaced
+	//  as a whole, it may be the one that is mapped.
+	bool save(const std::string &filename) const;
+	// Whether save would write anything but the opened file
+	bool modified() const;
+	// Hits, misses and entries
+	std::string report() const;
+
+	MeshCache();
+	~MeshCache();
+	MeshCache(const MeshCache&) = delete;
+	MeshCache &operator=(const MeshCache&) = delete;
+};
+
+#endif
@@ -0,0 +1,364 @@
+#include <Mesher/Mesher.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+constexpr int Mesher::directions;
+constexpr int Mesher::sections;
+constexpr uint32_t Mesher::version;
+
+namespace {
+	constexpr int size_xy = 16;
+	constexpr int size_z = 256;
+	constexpr int words = size_z/64;
+	// Columns including the one voxel border around the chunk
+	constexpr int columns_xy = size_xy+2;
+
+	// Axis the slices of each direction are stacked along, and the axes of
+	//  a slice's rows (u, 16 wide) and of the rows themselves (v)
+	const int slice_axes[6][3] = {
+		{2, 0, 1}, {0, 1, 2}, {1, 0, 2}, {0, 1, 2}, {1, 0, 2}, {2, 0, 1}
+	};
+
+	// Faces of one row of a slice by block ID: bit u of masks[k] is set for
+	//  a face of block ids[k] at u
+	struct IDRow {
+		int count;
+		uint8_t ids[size_xy];
+		uint16_t masks[size_xy];
+
+		// The mask of id, nullptr if the row has no faces of it
+		uint16_t *find(uint8_t id) {
+			for(int k=0;k<count;++k) {
+				if(ids[k] == id)
+					return &masks[k];
+			}
+			return nullptr;
+		}
+	};
+
+	struct Scratch {
+		// Occupancy of column (x, y), bit z%64 of word z/64
+		uint64_t occupancy[columns_xy*columns_xy][words];
+		// Visible faces of each direction, same layout without the border
+		uint64_t faces[6][size_xy*size_xy][words];
+		// Rows of one slice, bit u set for a face at (u, v)
+		uint16_t rows[size_z];
+		// The same rows split by block ID
+		IDRow id_rows[size_z];
+		// Quads of each section of the current direction until they are
+		//  appended in order
+		std::vector<Mesher::Quad> section_quads[Mesher::sections];
+	};
+
+	size_t column(int x, int y) {
+		return (y+1)*columns_xy + (x+1);
+	}
+}
+
+Mesher::Quad Mesher::Quad::pack(
+	int direction, const int first[3], int width, int height, uint8_t id
+) {
+	Quad quad;
+	quad.packed = first[0] | first[1] << 4 | first[2] << 8
+		| (width-1) << 16 | (height-1) << 20 | direction << 28;
+	quad.id = id;
+	return quad;
+}
+
+int Mesher::Quad::direction() const {
+	return packed >> 28 & 7;
+}
+
+int Mesher::Quad::width() const {
+	return (packed >> 16 & 15) + 1;
+}
+
+int Mesher::Quad::height() const {
+	return (packed >> 20 & 255) + 1;
+}
+
+int Mesher::Quad::section() const {
+	return (packed >> 8 & 255)/16;
+}
+
+int Mesher::Quad::u_axis(int direction) {
+	return slice_axes[direction][1];
+}
+
+int Mesher::Quad::v_axis(int direction) {
+	return slice_axes[direction][2];
+}
+
+Mesher::Stats Mesher::mesh(
+	const PaddedChunk &voxels, std::vector<Quad> &out, bool skip_bottom
+) {
+	return mesh(voxels, 0, sections, out, skip_bottom);
+}
+
+Mesher::Stats Mesher::mesh(
+	const PaddedChunk &voxels, int first, int last, std::vector<Quad> &out,
+	bool skip_bottom
+) {
+	static thread_local Scratch scratch;
+	Stats stats{};
+	int z0 = first*16;
+	int z1 = last*16;
+
+	// Occupancy words for every column, border included, of the sections
+	//  and the layers right above and below them. Above and below the chunk
+	//  is air.
+	std::memset(scratch.occupancy, 0, sizeof(scratch.occupancy));
+	for(int z=std::max(z0-1, 0);z<std::min(z1+1, size_z);++z) {
+		for(int y=-1;y<=size_xy;++y) {
+			const uint8_t *row = voxels.data() + PaddedChunk::index(-1, y, z);
+			uint64_t bit = 1ull << (z%64);
+			for(int x=0;x<columns_xy;++x) {
+				if(row[x])
+					scratch.occupancy[(y+1)*columns_xy + x][z/64] |= bit;
+			}
+		}
+	}
+
+	// Bits of each word that lie in the sections
+	uint64_t in_range[words];
+	for(int w=0;w<words;++w) {
+		int lo = std::max(z0-w*64, 0);
+		int hi = std::min(z1-w*64, 64);
+		in_range[w] = 0;
+		if(hi > lo)
+			in_range[w] = (hi-lo == 64 ? ~0ull : ((1ull << (hi-lo)) - 1)) << lo;
+	}
+
+	// A face is visible where the neighbour in its direction is air
+	for(int y=0;y<size_xy;++y) {
+		for(int x=0;x<size_xy;++x) {
+			const uint64_t *self = scratch.occupancy[column(x, y)];
+			const uint64_t *neighbours[4] = {
+				scratch.occupancy[column(x-1, y)], scratch.occupancy[column(x, y-1)],
+				scratch.occupancy[column(x+1, y)], scratch.occupancy[column(x, y+1)],
+			};
+			size_t c = y*size_xy + x;
+			for(int w=0;w<words;++w) {
+				// Bit z of above holds z-1, bit z of below holds z+1
+				uint64_t above = (self[w] << 1) | (w > 0 ? self[w-1] >> 63 : 0);
+				uint64_t below = (self[w] >> 1) | (w+1 < words ? self[w+1] << 63 : 0);
+				scratch.faces[0][c][w] = self[w] & ~above;
+				scratch.faces[1][c][w] = self[w] & ~neighbours[0][w];
+				scratch.faces[2][c][w] = self[w] & ~neighbours[1][w];
+				scratch.faces[3][c][w] = self[w] & ~neighbours[2][w];
+				scratch.faces[4][c][w] = self[w] & ~neighbours[3][w];
+				scratch.faces[5][c][w] = self[w] & ~below;
+			}
+			if(skip_bottom)
+				scratch.faces[5][c][words-1] &= ~(1ull << 63);
+			for(int n=0;n<directions;++n) {
+				for(int w=0;w<words;++w) {
+					scratch.faces[n][c][w] &= in_range[w];
+					stats.faces += __builtin_popcountll(scratch.faces[n][c][w]);
+				}
+			}
+		}
+	}
+
+	for(int n=0;n<directions;++n) {
+		for(auto &quads : scratch.section_quads)
+			quads.clear();
+		int slice_axis = slice_axes[n][0];
+		int u_axis = slice_axes[n][1];
+		int v_axis = slice_axes[n][2];
+		int slices = slice_axis == 2 ? size_z : size_xy;
+		int v_size = v_axis == 2 ? size_z : size_xy;
+		// Slices and rows along z are limited to the sections
+		int slice_begin = slice_axis == 2 ? z0 : 0;
+		int slice_end = slice_axis == 2 ? z1 : slices;
+		int v_begin = v_axis == 2 ? z0 : 0;
+		int v_end = v_axis == 2 ? z1 : v_size;
+
+		for(int slice=slice_begin;slice<slice_end;++slice) {
+			// Gather the slice's faces into rows along u
+			uint16_t *rows = scratch.rows;
+			std::memset(rows, 0, v_size*sizeof(uint16_t));
+			bool any = false;
+			if(slice_axis == 2) {
+				int w = slice/64;
+				uint64_t bit = 1ull << (slice%64);
+				for(int y=0;y<size_xy;++y) {
+					for(int x=0;x<size_xy;++x) {
+						if(scratch.faces[n][y*size_xy + x][w] & bit) {
+							rows[y] |= 1 << x;
+							any = true;
+						}
+					}
+				}
+			}
+			else {
+				for(int u=0;u<size_xy;++u) {
+					int x = slice_axis == 0 ? slice : u;
+					int y = slice_axis == 0 ? u : slice;
+					const uint64_t *face = scratch.faces[n][y*size_xy + x];
+					for(int w=0;w<words;++w) {
+						uint64_t bits = face[w];
+						any = any || bits;
+						while(bits) {
+							rows[w*64 + __builtin_ctzll(bits)] |= 1 << u;
+							bits &= bits-1;
+						}
+					}
+				}
+			}
+			if(!any)
+				continue;
+
+			auto id_at = [&](int u, int v) {
+				int p[3];
+				p[slice_axis] = slice;
+				p[u_axis] = u;
+				p[v_axis] = v;
+				return voxels.get(p[0], p[1], p[2]);
+			};
+
+			// Split each row's faces by block ID, so merging only needs
+			//  the masks
+			for(int v=v_begin;v<v_end;++v) {
+				IDRow &id_row = scratch.id_rows[v];
+				id_row.count = 0;
+				for(uint32_t bits=rows[v];bits;bits&=bits-1) {
+					int u = __builtin_ctz(bits);
+					uint8_t id = id_at(u, v);
+					uint16_t *mask = id_row.find(id);
+					if(!mask) {
+						id_row.ids[id_row.count] = id;
+						mask = &id_row.masks[id_row.count++];
+						*mask = 0;
+					}
+					*mask |= 1 << u;
+				}
+			}
+
+			// Greedy merge on the masks: the lowest run of a block's faces
+			//  along u first, then as many following rows as hold the same
+			//  run of the same block, up to the end of the section when v
+			//  is z. The rows a quad covers lose its run.
+			for(int v=v_begin;v<v_end;++v) {
+				int rows_end = v_axis == 2 ? (v/16+1)*16 : v_size;
+				IDRow &id_row = scratch.id_rows[v];
+				for(int k=0;k<id_row.count;++k) {
+					uint8_t id = id_row.ids[k];
+					while(id_row.masks[k]) {
+						uint32_t mask = id_row.masks[k];
+						int u0 = __builtin_ctz(mask);
+						int width = __builtin_ctz(~(mask >> u0));
+						uint16_t run = ((1u << width) - 1) << u0;
+						id_row.masks[k] &= ~run;
+
+						int v1 = v+1;
+						for(;v1<rows_end;++v1) {
+							uint16_t *below = scratch.id_rows[v1].find(id);
+							if(!below || (*below & run) != run)
+								break;
+							*below &= ~run;
+						}
+
+						int first[3];
+						first[slice_axis] = slice;
+						first[u_axis] = u0;
+						first[v_axis] = v;
+						scratch.section_quads[first[2]/16].push_back(
+							Quad::pack(n, first, width, v1-v, id)
+						);
+					}
+				}
+			}
+		}
+
+		for(int s=first;s<last;++s) {
+			const std::vector<Quad> &quads = scratch.section_quads[s];
+			out.insert(out.end(), quads.begin(), quads.end());
+			stats.range_quads[n][s] = quads.size();
+			stats.quads += quads.size();
+		}
+	}
+	return stats;
+}
+
+Mesher::Stats Mesher::remesh(
+	const PaddedChunk &voxels, uint16_t dirty, std::vector<Quad> &mesh,
+	uint32_t range_quads[directions][sections], bool skip_bottom
+) {
+	static thread_local std::vector<Quad> rebuilt;
+	static thread_local std::vector<Quad> merged;
+	rebuilt.clear();
+	Stats stats{};
+
+	// Consecutive dirty sections are meshed together. Each run's quads are
+	//  sorted by direction and section within the run, rebuilt_first holds
+	//  where each of its ranges starts in rebuilt.
+	uint32_t rebuilt_first[directions][sections];
+	uint32_t rebuilt_quads[directions][sections];
+	for(int first=0;first<sections;) {
+		if(!(dirty >> first & 1)) {
+			++first;
+			continue;
+		}
+		int last = first+1;
+		while(last < sections && (dirty >> last & 1))
+			++last;
+		uint32_t offset = rebuilt.size();
+		Stats run = Mesher::mesh(voxels, first, last, rebuilt, skip_bottom);
+		for(int n=0;n<directions;++n) {
+			for(int s=first;s<last;++s) {
+				rebuilt_first[n][s] = offset;
+				rebuilt_quads[n][s] = run.range_quads[n][s];
+				offset += run.range_quads[n][s];
+			}
+		}
+		stats.faces += run.faces;
+		first = last;
+	}
+
+	// Interleave the rebuilt ranges with the kept ones
+	merged.clear();
+	uint32_t kept_first = 0;
+	for(int n=0;n<directions;++n) {
+		for(int s=0;s<sections;++s) {
+			uint32_t count = range_quads[n][s];
+			if(dirty >> s & 1) {
+				auto begin = rebuilt.begin() + rebuilt_first[n][s];
+				merged.insert(merged.end(), begin, begin + rebuilt_quads[n][s]);
+				range_quads[n][s] = rebuilt_quads[n][s];
+			}
+			else {
+				auto begin = mesh.begin() + kept_first;
+				merged.insert(merged.end(), begin, begin + count);
+			}
+			kept_first += count;
+			stats.range_quads[n][s] = range_quads[n][s];
+			stats.quads += range_quads[n][s];
+		}
+	}
+	mesh.swap(merged);
+	return stats;
+}
+
+void Mesher::sort(
+	std::vector<Quad> &quads, uint32_t range_quads[directions][sections]
+) {
+	std::memset(range_quads, 0, sizeof(uint32_t)*directions*sections);
+	for(const Quad &quad : quads)
+		++range_quads[quad.direction()][quad.section()];
+
+	uint32_t next[directions][sections];
+	uint32_t first = 0;
+	for(int n=0;n<directions;++n) {
+		for(int s=0;s<sections;++s) {
+			next[n][s] = first;
+			first += range_quads[n][s];
+		}
+	}
+	static thread_local std::vector<Quad> sorted;
+	sorted.resize(quads.size());
+	for(const Quad &quad : quads)
+		sorted[next[quad.direction()][quad.section()]++] = quad;
+	quads.swap(sorted);
+}
@@ -0,0 +1,96 @@
+#ifndef MESHER_HEADER
+#define MESHER_HEADER
+
+#include <Storage/PaddedChunk.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Builds chunk meshes on the CPU, as an alternative to the generate
+//  shaders. Output is the same list of quads they produce, see Quad.
+//
+//  Faces are found on 64 voxel long occupancy words along z: a face exists
+//  where a solid bit meets an air bit in the neighbouring column, or in the
+//  same column shifted by one. Each slice's faces are then split into 16 bit
+//  rows per block ID and merged greedily into rectangles on those masks:
+//  run widths come from counting trailing bits, heights from testing the
+//  run against the rows that follow. Quads are textured repeating.
+class Mesher
+{
+public:
+	// Directions in the order used by the generate shader:
+	//  -z, -x, -y, +x, +y, +z
+	static constexpr int directions = 6;
+	// Quads never cross the boundary between two 16 high sections, so each
+	//  section's quads can be drawn and rebuilt on their own. Meshes are
+	//  sorted by direction, then by section, so each direction of each
+	//  section is one range of quads.
+	static constexpr int sections = 16;
+	// Changes whenever the quads produced for the same voxels or their
+	//  format change, so saved meshes of older versions aren't used
+	static constexpr uint32_t version = 2;
+
+	// A merged face in 8 bytes, the mesh format the render shader expands
+	//  into two triangles. Faces are merged along two axes u and v that
+	//  depend on the direction: u is x for -z, -y, +y and +z and y
+	//  otherwise, v is y for -z and +z and z otherwise.
+	//
+	//  packed holds, from the lowest bit, the chunk coordinates of the
+	//  quad's first block (4 bits x, 4 bits y, 8 bits z), its width along u
+	//  minus one (4 bits), its height along v minus one (8 bits) and the
+	//  direction (3 bits).
+	struct Quad {
+		uint32_t packed;
+		uint32_t id;
+
+		static Quad pack(
+			int direction, const int first[3], int width, int height, uint8_t id
+		);
+		int direction() const;
+		int width() const;
+		int height() const;
+		int section() const;
+		// Axis u or v run along for a direction, 0 to 2 for x to z
+		static int u_axis(int direction);
+		static int v_axis(int direction);
+	};
+
+	struct Stats {
+		// Visible voxel faces before merging
+		size_t faces;
+		size_t quads;
+		// Quads of each direction and section, in the order they were
+		//  appended
+		uint32_t range_quads[directions][sections];
+	};
+
+	// Appends the quads of the chunk in voxels to out, sorted by direction
+	//  and section.
+	//  With skip_bottom the bottom faces of the lowest layer are left out,
+	//  as they can never be seen.
+	static Stats mesh(
+		const PaddedChunk &voxels, std::vector<Quad> &out, bool skip_bottom = true
+	);
+	// The same for sections [first, last) only, e.g. to rebuild the
+	//  sections an edit touched. Ranges of other sections stay empty.
+	static Stats mesh(
+		const PaddedChunk &voxels, int first, int last, std::vector<Quad> &out,
+		bool skip_bottom = true
+	);
+	// Rebuilds the sections with their bit set in sections within mesh, a
+	//  whole chunk's quads in the order mesh produces with range_quads
+	//  holding their counts. Quads of the other sections are kept.
+	static Stats remesh(
+		const PaddedChunk &voxels, uint16_t sections, std::vector<Quad> &mesh,
+		uint32_t range_quads[directions][Mesher::sections], bool skip_bottom = true
+	);
+	// Brings quads from other meshers into the order mesh produces and
+	//  counts the quads of each direction and section. Quads keep their
+	//  order within a range.
+	static void sort(
+		std::vector<Quad> &quads, uint32_t range_quads[directions][sections]
+	);
+};
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef BOUNDED_QUEUE
+#define BOUNDED_QUEUE
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// Lock-free multi-producer multi-consumer queue with a fixed capacity.
+//  Every cell carries a sequence number which tells producers and consumers
+//  whose turn it is, so neither side ever takes a lock (D. Vyukov's design).
+//
+//  push and pop sleep on a condition variable when they have to wait. The
+//  lock is only taken on the slow path: a successful push or pop notifies
+//  only if some thread registered as waiting.
+template<typename T>
+class BoundedQueue
+{
+private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T data;
+	};
+	std::unique_ptr<Cell[]> m_buffer;
+	size_t m_mask;
+	// Keep producer and consumer positions on separate cache lines
+	char m_pad0[64];
+	std::atomic<size_t> m_enqueue_pos;
+	char m_pad1[64];
+	std::atomic<size_t> m_dequeue_pos;
+	char m_pad2[64];
+
+	std::mutex m_wait_mutex;
+	std::condition_variable m_not_full;
+	std::condition_variable m_not_empty;
+	// Threads sleeping in push and pop
+	std::atomic<int> m_waiting_push;
+	std::atomic<int> m_waiting_pop;
+	std::atomic<bool> m_closed;
+
+	bool try_push_nowake(T &value);
+	bool try_pop_nowake(T &value);
+	// Wakes the threads waiting in cv if waiting says there are any
+	void wake(std::atomic<int> &waiting, std::condition_variable &cv);
+public:
+	// Moves value into the queue. Returns false if the queue is full.
+	bool try_push(T &value);
+	// Moves the oldest element into value. Returns false if the queue is empty.
+	bool try_pop(T &value);
+	// Like try_push, but sleeps until there is a free cell instead of failing.
+	void push(T &value);
+	// Like try_pop, but sleeps until there is an element. Returns false
+	//  only once the queue is closed and empty.
+	bool pop(T &value);
+	// Tells pop that nothing more will be pushed and wakes its waiters
+	void close();
+
+	size_t capacity() const;
+	// Number of elements in the queue, may be stale by the time it returns
+	size_t size_approx() const;
+
+	// capacity is rounded up to the next power of two
+	BoundedQueue(size_t capacity);
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue &operator=(const BoundedQueue&) = delete;
+};
+
+template<typename T>
+bool BoundedQueue<T>::try_push_nowake(T &value) {
+	size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+	for(;;) {
+		Cell &cell = m_buffer[pos & m_mask];
+		size_t seq = cell.sequence.load(std::memory_order_acquire);
+		intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+		if(diff == 0) {
+			if(m_enqueue_pos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) {
+				cell.data = std::move(value);
+				cell.sequence.store(pos+1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if(diff < 0) {
+			return false;
+		}
+		else {
+			pos = m_enqueue_pos.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+template<typename T>
+bool BoundedQueue<T>::try_pop_nowake(T &value) {
+	size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+	for(;;) {
+		Cell &cell = m_buffer[pos & m_mask];
+		size_t seq = cell.sequence.load(std::memory_order_acquire);
+		intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos+1);
+		if(diff == 0) {
+			if(m_dequeue_pos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) {
+				value = std::move(cell.data);
+				cell.sequence.store(pos+m_mask+1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if(diff < 0) {
+			return false;
+		}
+		else {
+			pos = m_dequeue_pos.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+template<typename T>
+void BoundedQueue<T>::wake(std::atomic<int> &waiting, std::condition_variable &cv) {
+	// Pairs with the increment in push and pop: either the waiter sees the
+	//  cell just published, or we see the waiter
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(waiting.load(std::memory_order_relaxed) == 0)
+		return;
+	std::lock_guard<std::mutex> lock(m_wait_mutex);
+	cv.notify_all();
+}
+
+template<typename T>
+bool BoundedQueue<T>::try_push(T &value) {
+	if(!try_push_nowake(value))
+		return false;
+	wake(m_waiting_pop, m_not_empty);
+	return true;
+}
+
+template<typename T>
+bool BoundedQueue<T>::try_pop(T &value) {
+	if(!try_pop_nowake(value))
+		return false;
+	wake(m_waiting_push, m_not_full);
+	return true;
+}
+
+template<typename T>
+void BoundedQueue<T>::push(T &value) {
+	if(try_push(value))
+		return;
+	std::unique_lock<std::mutex> lock(m_wait_mutex);
+	m_waiting_push.fetch_add(1, std::memory_order_seq_cst);
+	while(!try_push_nowake(value))
+		m_not_full.wait(lock);
+	m_waiting_push.fetch_sub(1, std::memory_order_relaxed);
+	lock.unlock();
+	wake(m_waiting_pop, m_not_empty);
+}
+
+template<typename T>
+bool BoundedQueue<T>::pop(T &value) {
+	if(try_pop(value))
+		return true;
+	std::unique_lock<std::mutex> lock(m_wait_mutex);
+	m_waiting_pop.fetch_add(1, std::memory_order_seq_cst);
+	bool popped;
+	for(;;) {
+		popped = try_pop_nowake(value);
+		if(popped)
+			break;
+		// Check for closing before the final attempt, so an element pushed
+		//  right before close() isn't missed
+		if(m_closed.load(std::memory_order_acquire)) {
+			popped = try_pop_nowake(value);
+			break;
+		}
+		m_not_empty.wait(lock);
+	}
+	m_waiting_pop.fetch_sub(1, std::memory_order_relaxed);
+	lock.unlock();
+	if(popped)
+		wake(m_waiting_push, m_not_full);
+	return popped;
+}
+
+template<typename T>
+void BoundedQueue<T>::close() {
+	m_closed.store(true, std::memory_order_release);
+	std::lock_guard<std::mutex> lock(m_wait_mutex);
+	m_not_empty.notify_all();
+}
+
+template<typename T>
+size_t BoundedQueue<T>::capacity() const {
+	return m_mask+1;
+}
+
+template<typename T>
+size_t BoundedQueue<T>::size_approx() const {
+	size_t enqueued = m_enqueue_pos.load(std::memory_order_relaxed);
+	size_t dequeued = m_dequeue_pos.load(std::memory_order_relaxed);
+	return enqueued > dequeued ? enqueued - dequeued : 0;
+}
+
+template<typename T>
+BoundedQueue<T>::BoundedQueue(size_t capacity) {
+	size_t size = 2;
+	while(size < capacity)
+		size *= 2;
+	m_buffer.reset(new Cell[size]);
+	m_mask = size-1;
+	for(size_t i=0;i<size;++i)
+		m_buffer[i].sequence.store(i, std::memory_order_relaxed);
+	m_enqueue_pos.store(0, std::memory_order_relaxed);
+	m_dequeue_pos.store(0, std::memory_order_relaxed);
+	m_waiting_push.store(0, std::memory_order_relaxed);
+	m_waiting_pop.store(0, std::memory_order_relaxed);
+	m_closed.store(false, std::memory_order_relaxed);
+}
+
+#endif
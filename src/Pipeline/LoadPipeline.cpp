@@ -0,0 +1,304 @@
+#include <Pipeline/LoadPipeline.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace {
+	using clock_type = std::chrono::high_resolution_clock;
+
+	uint64_t elapsed_ns(clock_type::time_point from, clock_type::time_point to) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(to-from).count();
+	}
+
+	void atomic_max(std::atomic<uint64_t> &a, uint64_t value) {
+		uint64_t current = a.load(std::memory_order_relaxed);
+		while(current < value && !a.compare_exchange_weak(current, value, std::memory_order_relaxed));
+	}
+
+	const char *stage_names[] = {
+		"read", "inflate", "parse", "transpose", "upload"
+	};
+}
+
+LoadPipeline::Config::Config() {
+	int hw = std::max(1u, std::thread::hardware_concurrency());
+	read_workers = 1;
+	inflate_workers = std::max(1, hw/3);
+	parse_workers = std::max(1, hw/3);
+	transpose_workers = 1;
+	queue_capacity = 64;
+}
+
+void LoadPipeline::add_region(std::string filename, int x, int y) {
+	if(m_started)
+		return;
+	m_map.reserve(x, y);
+	m_region_files.push_back({filename, x, y});
+}
+
+void LoadPipeline::start() {
+	if(m_started)
+		return;
+	m_started = true;
+	m_time_start = clock_type::now();
+
+	int workers[STAGE_COUNT] = {
+		m_config.read_workers, m_config.inflate_workers,
+		m_config.parse_workers, m_config.transpose_workers, 1
+	};
+	for(int s=0;s<STAGE_COUNT;++s) {
+		workers[s] = std::max(1, workers[s]);
+		m_stats[s].workers = workers[s];
+		m_workers_alive[s] = workers[s];
+	}
+
+	for(int i=0;i<workers[READ];++i) {
+		m_threads.emplace_back([this]{ read_worker(); });
+	}
+	for(int i=0;i<workers[INFLATE];++i) {
+		m_threads.emplace_back([this]{
+			stage_worker(INFLATE, [](Job &job) {
+				bool ok = MapLoader::inflate_chunk(job.raw, job.nbt, job.nbt_len);
+				job.raw.data = std::vector<uint8_t>();
+				return ok;
+			});
+		});
+	}
+	for(int i=0;i<workers[PARSE];++i) {
+		m_threads.emplace_back([this]{
+			stage_worker(PARSE, [](Job &job) {
+				bool ok = MapLoader::parse_chunk(job.nbt.data(), job.nbt_len, job.sections);
+				job.nbt = std::vector<uint8_t>();
+				return ok;
+			});
+		});
+	}
+	for(int i=0;i<workers[TRANSPOSE];++i) {
+		m_threads.emplace_back([this]{
+			stage_worker(TRANSPOSE, [this](Job &job) {
+				MC::Region &region = m_map.regions[job.region_x][job.region_y];
+				MapLoader::transpose_chunk(
+					job.sections, region.chunks[job.raw.index], m_map.storage
+				);
+				job.sections = std::vector<MC::RawSection>();
+				return true;
+			});
+		});
+	}
+}
+
+void LoadPipeline::read_worker() {
+	// Every reader takes whole region files, so reads within a file stay
+	//  sequential.
+	for(;;) {
+		size_t next = m_next_region.fetch_add(1);
+		if(next >= m_region_files.size())
+			break;
+		const RegionFile &rf = m_region_files[next];
+		MC::Region &region = m_map.regions[rf.x][rf.y];
+
+		auto t0 = clock_type::now();
+		std::ifstream file(rf.filename, std::ios::binary | std::ios::in);
+		if(!file.is_open() || !MapLoader::read_region_header(file, region)) {
+			m_stats[READ].busy_ns += elapsed_ns(t0, clock_type::now());
+			continue;
+		}
+		m_stats[READ].busy_ns += elapsed_ns(t0, clock_type::now());
+
+		for(uint32_t i=0;i<1024;++i) {
+			t0 = clock_type::now();
+			JobPtr job(new Job);
+			job->region_x = rf.x;
+			job->region_y = rf.y;
+			bool ok = MapLoader::read_raw_chunk(file, region.locations.table[i], i, job->raw);
+			m_stats[READ].busy_ns += elapsed_ns(t0, clock_type::now());
+			if(!ok)
+				continue;
+			++m_stats[READ].items;
+			push_job(READ, job);
+		}
+	}
+	worker_done(READ);
+}
+
+template<typename F>
+void LoadPipeline::stage_worker(Stage stage, F work) {
+	JobPtr job;
+	while(pop_job(stage, job)) {
+		auto t0 = clock_type::now();
+		bool ok = work(*job);
+		m_stats[stage].busy_ns += elapsed_ns(t0, clock_type::now());
+		++m_stats[stage].items;
+		// Chunks that failed to load are dropped here
+		if(ok)
+			push_job(stage, job);
+		job.reset();
+	}
+	worker_done(stage);
+}
+
+bool LoadPipeline::pop_job(Stage stage, JobPtr &job) {
+	BoundedQueue<JobPtr> &in = *m_queues[stage-1];
+	StageStats &stats = m_stats[stage];
+
+	auto t0 = clock_type::now();
+	uint64_t occupancy = in.size_approx();
+	// Sleeps until there is a job or the previous stage closed the queue
+	bool popped = in.pop(job);
+	stats.starved_ns += elapsed_ns(t0, clock_type::now());
+
+	if(popped) {
+		++stats.queue_samples;
+		stats.queue_sum += occupancy;
+		atomic_max(stats.queue_max, occupancy);
+	}
+	return popped;
+}
+
+void LoadPipeline::push_job(Stage stage, JobPtr &job) {
+	auto t0 = clock_type::now();
+	m_queues[stage]->push(job);
+	m_stats[stage].blocked_ns += elapsed_ns(t0, clock_type::now());
+}
+
+void LoadPipeline::worker_done(Stage stage) {
+	if(--m_workers_alive[stage] == 0) {
+		m_stage_done[stage].store(true, std::memory_order_release);
+		// Wakes the next stage's workers waiting for input
+		if(stage != UPLOAD)
+			m_queues[stage]->close();
+	}
+}
+
+size_t LoadPipeline::poll(const UploadFunction &upload, size_t max_chunks) {
+	if(!m_started || m_stage_done[UPLOAD])
+		return 0;
+
+	size_t uploaded = 0;
+	while(uploaded < max_chunks) {
+		bool transpose_done = m_stage_done[TRANSPOSE].load(std::memory_order_acquire);
+		JobPtr job;
+		uint64_t occupancy = m_queues[TRANSPOSE]->size_approx();
+		if(!m_queues[TRANSPOSE]->try_pop(job)) {
+			if(transpose_done) {
+				m_time_end = clock_type::now();
+				m_stage_done[UPLOAD] = true;
+			}
+			break;
+		}
+		upload_job(*job, occupancy, upload);
+		++uploaded;
+	}
+	return uploaded;
+}
+
+size_t LoadPipeline::poll_wait(const UploadFunction &upload, size_t max_chunks) {
+	if(!m_started || m_stage_done[UPLOAD] || !max_chunks)
+		return 0;
+
+	// Sleeps on the queue until transpose delivers a chunk or closes it
+	JobPtr job;
+	auto t0 = clock_type::now();
+	uint64_t occupancy = m_queues[TRANSPOSE]->size_approx();
+	bool popped = m_queues[TRANSPOSE]->pop(job);
+	m_stats[UPLOAD].starved_ns += elapsed_ns(t0, clock_type::now());
+	if(!popped) {
+		m_time_end = clock_type::now();
+		m_stage_done[UPLOAD] = true;
+		return 0;
+	}
+	upload_job(*job, occupancy, upload);
+	return 1 + poll(upload, max_chunks-1);
+}
+
+void LoadPipeline::upload_job(Job &job, uint64_t occupancy, const UploadFunction &upload) {
+	++m_stats[UPLOAD].queue_samples;
+	m_stats[UPLOAD].queue_sum += occupancy;
+	atomic_max(m_stats[UPLOAD].queue_max, occupancy);
+
+	auto t0 = clock_type::now();
+	MC::Region &region = m_map.regions[job.region_x][job.region_y];
+	upload(job.region_x, job.region_y, job.raw.index, region.chunks[job.raw.index]);
+	m_stats[UPLOAD].busy_ns += elapsed_ns(t0, clock_type::now());
+	++m_stats[UPLOAD].items;
+}
+
+bool LoadPipeline::finished() const {
+	return m_stage_done[UPLOAD];
+}
+
+std::string LoadPipeline::report() const {
+	auto end = finished() ? m_time_end : clock_type::now();
+	double wall = m_started ? elapsed_ns(m_time_start, end)/1e9 : 0.0;
+
+	std::string out;
+	char line[256];
+	std::snprintf(line, sizeof(line), "Load pipeline: %.3fs wall\n", wall);
+	out += line;
+	std::snprintf(
+		line, sizeof(line), "  %-10s %7s %7s %10s %7s %7s %7s %13s\n",
+		"stage", "workers", "items", "items/s", "busy", "starved", "blocked",
+		"queue avg/max"
+	);
+	out += line;
+	for(int s=0;s<STAGE_COUNT;++s) {
+		const StageStats &st = m_stats[s];
+		// Percentages are relative to the total time of all workers
+		double worker_time = std::max(wall*st.workers, 1e-9);
+		uint64_t samples = st.queue_samples;
+		char queue[32] = "-";
+		if(s != READ) {
+			std::snprintf(
+				queue, sizeof(queue), "%.1f/%llu",
+				samples ? static_cast<double>(st.queue_sum)/samples : 0.0,
+				static_cast<unsigned long long>(st.queue_max.load())
+			);
+		}
+		std::snprintf(
+			line, sizeof(line),
+			"  %-10s %7d %7llu %10.1f %6.1f%% %6.1f%% %6.1f%% %13s\n",
+			stage_names[s], st.workers,
+			static_cast<unsigned long long>(st.items.load()),
+			wall > 0.0 ? st.items/wall : 0.0,
+			100.0*st.busy_ns/1e9/worker_time,
+			100.0*st.starved_ns/1e9/worker_time,
+			100.0*st.blocked_ns/1e9/worker_time,
+			queue
+		);
+		out += line;
+	}
+	return out;
+}
+
+LoadPipeline::LoadPipeline(MapLoader &map, Config config):
+	m_map(map),
+	m_config{config},
+	m_next_region{0},
+	m_started{false}
+{
+	for(int s=0;s<STAGE_COUNT-1;++s) {
+		m_queues[s].reset(new BoundedQueue<JobPtr>(m_config.queue_capacity));
+	}
+	for(int s=0;s<STAGE_COUNT;++s) {
+		m_stats[s].workers = 0;
+		m_stats[s].items = 0;
+		m_stats[s].busy_ns = 0;
+		m_stats[s].starved_ns = 0;
+		m_stats[s].blocked_ns = 0;
+		m_stats[s].queue_samples = 0;
+		m_stats[s].queue_sum = 0;
+		m_stats[s].queue_max = 0;
+		m_workers_alive[s] = 0;
+		m_stage_done[s] = false;
+	}
+}
+
+LoadPipeline::~LoadPipeline() {
+	// Drain whatever is left so the workers can't stay blocked on a full
+	//  upload queue.
+	while(m_started && !finished())
+		poll_wait([](int, int, uint32_t, MC::Chunk&){}, 1024);
+	for(auto &t : m_threads)
+		t.join();
+}
@@ -0,0 +1,125 @@
+#ifndef LOAD_PIPELINE
+#define LOAD_PIPELINE
+
+#include <MapLoader/MapLoader.hpp>
+#include <Pipeline/BoundedQueue.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loads region files through a chain of stages, each with its own worker
+//  threads, connected by bounded queues:
+//
+//    read -> inflate -> parse -> transpose -> upload
+//
+//  The first four stages run on worker threads and fill MapLoader::regions.
+//  Upload runs on whichever thread calls poll(), which should be the one
+//  owning the GL context. A full queue blocks the stage feeding it, so at
+//  most a few queue capacities of chunks are in flight at any time.
+class LoadPipeline
+{
+public:
+	struct Config {
+		int read_workers;
+		int inflate_workers;
+		int parse_workers;
+		int transpose_workers;
+		size_t queue_capacity;
+		// Picks worker counts based on std::thread::hardware_concurrency
+		Config();
+	};
+
+	using UploadFunction = std::function<
+		void(int region_x, int region_y, uint32_t index, MC::Chunk &chunk)
+	>;
+
+	enum Stage {
+		READ,
+		INFLATE,
+		PARSE,
+		TRANSPOSE,
+		UPLOAD,
+		STAGE_COUNT
+	};
+
+	struct StageStats {
+		int workers;
+		std::atomic<uint64_t> items;
+		// Time spent working, waiting for input and waiting for space in the
+		//  next queue, summed over all workers of the stage
+		std::atomic<uint64_t> busy_ns;
+		std::atomic<uint64_t> starved_ns;
+		std::atomic<uint64_t> blocked_ns;
+		// Input queue occupancy, sampled every time an item is taken from it
+		std::atomic<uint64_t> queue_samples;
+		std::atomic<uint64_t> queue_sum;
+		std::atomic<uint64_t> queue_max;
+	};
+
+private:
+	// A chunk travelling through the pipeline. Each stage fills in its
+	//  output and releases the input it no longer needs.
+	struct Job {
+		int region_x;
+		int region_y;
+		MC::RawChunk raw;
+		std::vector<uint8_t> nbt;
+		size_t nbt_len;
+		std::vector<MC::RawSection> sections;
+	};
+	using JobPtr = std::unique_ptr<Job>;
+
+	struct RegionFile {
+		std::string filename;
+		int x;
+		int y;
+	};
+
+	MapLoader &m_map;
+	Config m_config;
+	std::vector<RegionFile> m_region_files;
+	std::atomic<size_t> m_next_region;
+
+	// m_queues[s] feeds stage s+1
+	std::unique_ptr<BoundedQueue<JobPtr>> m_queues[STAGE_COUNT-1];
+	StageStats m_stats[STAGE_COUNT];
+	std::atomic<int> m_workers_alive[STAGE_COUNT];
+	std::atomic<bool> m_stage_done[STAGE_COUNT];
+	std::vector<std::thread> m_threads;
+	std::chrono::high_resolution_clock::time_point m_time_start;
+	std::chrono::high_resolution_clock::time_point m_time_end;
+	bool m_started;
+
+	void read_worker();
+	template<typename F>
+	void stage_worker(Stage stage, F work);
+	bool pop_job(Stage stage, JobPtr &job);
+	void push_job(Stage stage, JobPtr &job);
+	void worker_done(Stage stage);
+	void upload_job(Job &job, uint64_t occupancy, const UploadFunction &upload);
+public:
+	// Queues a region file to be loaded into map.regions[x][y]. Must be
+	//  called before start().
+	void add_region(std::string filename, int x, int y);
+	void start();
+	// Uploads at most max_chunks loaded chunks on the calling thread.
+	//  Returns the number of chunks uploaded.
+	size_t poll(const UploadFunction &upload, size_t max_chunks);
+	// Like poll, but sleeps until there is at least one chunk to upload or
+	//  the pipeline has finished
+	size_t poll_wait(const UploadFunction &upload, size_t max_chunks);
+	// True once every chunk has gone through poll()
+	bool finished() const;
+	// Per-stage throughput, time split and queue occupancy
+	std::string report() const;
+
+	LoadPipeline(MapLoader &map, Config config = Config());
+	~LoadPipeline();
+};
+
+#endif
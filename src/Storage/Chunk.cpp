@@ -0,0 +1,186 @@
+#include <Storage/Chunk.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+constexpr size_t MC::Chunk::section_count;
+constexpr size_t MC::Chunk::size;
+
+uint8_t MC::Chunk::get(int x, int y, int z) const {
+	if(storage == Storage::COLUMN_RLE)
+		return rle.get(x, y, z);
+	return sections[z>>4].get(SectionData::index(x, y, z&15));
+}
+
+void MC::Chunk::set(int x, int y, int z, uint8_t id, SectionStore &store) {
+	if(storage == Storage::COLUMN_RLE)
+		store_as(Storage::SECTIONS, store);
+	sections[z>>4].mutable_data()[SectionData::index(x, y, z&15)] = id;
+}
+
+void MC::Chunk::finish_edit(size_t s, SectionStore &store) {
+	if(storage == Storage::COLUMN_RLE)
+		return;
+	store.intern(sections[s]);
+}
+
+void MC::Chunk::expand(uint8_t *out) const {
+	if(storage == Storage::COLUMN_RLE) {
+		rle.decode(out);
+		return;
+	}
+	for(size_t s=0;s<section_count;++s) {
+		uint8_t *dst = out + s*SectionData::size;
+		if(sections[s].null())
+			std::memset(dst, 0, SectionData::size);
+		else
+			SectionData::to_linear(sections[s].data(), dst);
+	}
+}
+
+void MC::Chunk::assign(const uint8_t *voxels, SectionStore &store) {
+	if(!SectionData::morton) {
+		for(size_t s=0;s<section_count;++s)
+			sections[s] = store.intern(voxels + s*SectionData::size);
+	}
+	else {
+		uint8_t stored[SectionData::size];
+		for(size_t s=0;s<section_count;++s) {
+			SectionData::from_linear(voxels + s*SectionData::size, stored);
+			sections[s] = store.intern(stored);
+		}
+	}
+	rle.clear();
+	storage = Storage::SECTIONS;
+}
+
+void MC::Chunk::store_as(Storage target, SectionStore &store) {
+	if(target == storage)
+		return;
+	static thread_local std::vector<uint8_t> voxels(size);
+	expand(voxels.data());
+	if(target == Storage::COLUMN_RLE) {
+		rle.encode(voxels.data());
+		for(auto &section : sections)
+			section = SectionHandle();
+		storage = Storage::COLUMN_RLE;
+	}
+	else {
+		assign(voxels.data(), store);
+	}
+}
+
+Occupancy MC::Chunk::occupancy(size_t s) const {
+	if(storage == Storage::COLUMN_RLE)
+		return Occupancy::MIXED;
+	return sections[s].occupancy();
+}
+
+bool MC::Chunk::bounds(int min[3], int max[3]) const {
+	bool any = false;
+	if(storage == Storage::COLUMN_RLE) {
+		static thread_local std::vector<uint8_t> voxels(size);
+		expand(voxels.data());
+		for(int z=0;z<256;++z) {
+			for(int y=0;y<16;++y) {
+				for(int x=0;x<16;++x) {
+					if(!voxels[z*16*16 + y*16 + x])
+						continue;
+					int v[3] = {x, y, z};
+					for(int a=0;a<3;++a) {
+						min[a] = any ? std::min(min[a], v[a]) : v[a];
+						max[a] = any ? std::max(max[a], v[a]) : v[a];
+					}
+					any = true;
+				}
+			}
+		}
+		return any;
+	}
+
+	for(size_t s=0;s<section_count;++s) {
+		int lo[3], hi[3];
+		if(!section_bounds(s, lo, hi))
+			continue;
+		for(int a=0;a<3;++a) {
+			min[a] = any ? std::min(min[a], lo[a]) : lo[a];
+			max[a] = any ? std::max(max[a], hi[a]) : hi[a];
+		}
+		any = true;
+	}
+	return any;
+}
+
+bool MC::Chunk::section_bounds(size_t s, int min[3], int max[3]) const {
+	if(storage == Storage::COLUMN_RLE) {
+		min[0] = min[1] = 0;
+		max[0] = max[1] = 15;
+		min[2] = s*16;
+		max[2] = s*16 + 15;
+		return true;
+	}
+	if(!sections[s].bounds(min, max))
+		return false;
+	min[2] += s*16;
+	max[2] += s*16;
+	return true;
+}
+
+void MC::Chunk::candidate_voxels(std::vector<uint32_t> &out) const {
+	out.clear();
+	if(storage == Storage::COLUMN_RLE) {
+		static thread_local std::vector<uint8_t> voxels(size);
+		expand(voxels.data());
+		for(uint32_t i=0;i<size;++i) {
+			if(voxels[i])
+				out.push_back(i);
+		}
+		return;
+	}
+
+	for(uint32_t s=0;s<section_count;++s) {
+		uint32_t base = s*SectionData::size;
+		switch(sections[s].occupancy()) {
+		case Occupancy::EMPTY:
+			break;
+		case Occupancy::FULL:
+			// Only the shell can touch anything but this section's voxels
+			for(uint32_t z=0;z<16;++z) {
+				for(uint32_t y=0;y<16;++y) {
+					bool shell = z == 0 || z == 15 || y == 0 || y == 15;
+					for(uint32_t x=0;x<16;x+=(shell || x == 15) ? 1 : 15)
+						out.push_back(base + z*16*16 + y*16 + x);
+				}
+			}
+			break;
+		case Occupancy::MIXED: {
+			const uint64_t *mask = sections[s].mask();
+			for(uint32_t word=0;word<SectionData::size/64;++word) {
+				uint64_t bits = mask[word];
+				while(bits) {
+					out.push_back(base + word*64 + __builtin_ctzll(bits));
+					bits &= bits-1;
+				}
+			}
+			break;
+		}
+		}
+	}
+}
+
+size_t MC::Chunk::memory_usage() const {
+	if(storage == Storage::COLUMN_RLE)
+		return rle.memory_usage();
+	size_t bytes = 0;
+	for(auto &section : sections) {
+		if(!section.null())
+			bytes += SectionData::size;
+	}
+	return bytes;
+}
+
+MC::Chunk::Chunk():
+	storage{Storage::SECTIONS},
+	loaded{false}
+{;}
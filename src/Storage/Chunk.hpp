@@ -0,0 +1,67 @@
+#ifndef CHUNK_HEADER
+#define CHUNK_HEADER
+
+#include <Storage/Section.hpp>
+#include <Storage/RLEChunk.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace MC {
+	// How a resident chunk keeps its voxels
+	enum class Storage {
+		// 16 sections shared with every equal section of the world
+		SECTIONS,
+		// Runs along z per column, see RLEChunk
+		COLUMN_RLE
+	};
+
+	// A 16x16x256 column of voxels, indexed z*16*16 + y*16 + x like
+	//  everywhere else. As SECTIONS, sections[s] holds z in [16*s, 16*s+16).
+	struct Chunk {
+		static constexpr size_t section_count = 16;
+		static constexpr size_t size = 16*16*256;
+
+		SectionHandle sections[section_count];
+		RLEChunk rle;
+		Storage storage;
+		bool loaded;
+
+		uint8_t get(int x, int y, int z) const;
+		// Changes one voxel. Chunks stored as COLUMN_RLE switch to SECTIONS
+		//  first. The edited section stays unshared, with its summary out of
+		//  date, until finish_edit is called for it, so a batch of edits
+		//  only pays for that once.
+		void set(int x, int y, int z, uint8_t id, SectionStore &store = SectionStore::global());
+		// Updates sections[s] after edits and shares it with equal sections
+		void finish_edit(size_t s, SectionStore &store = SectionStore::global());
+		// Writes all voxels to out, which must hold Chunk::size bytes
+		void expand(uint8_t *out) const;
+		// Replaces the contents with Chunk::size voxels, interning every
+		//  section in store
+		void assign(const uint8_t *voxels, SectionStore &store = SectionStore::global());
+		// Switches to the given storage, converting the voxels
+		void store_as(Storage target, SectionStore &store = SectionStore::global());
+		// Occupancy of sections[s], chunks stored as COLUMN_RLE always
+		//  report MIXED
+		Occupancy occupancy(size_t s) const;
+		// Smallest box holding every solid voxel in chunk coordinates, both
+		//  corners inclusive. False if the chunk is all air.
+		bool bounds(int min[3], int max[3]) const;
+		// The same for sections[s]. Sections of chunks stored as
+		//  COLUMN_RLE report their whole extent.
+		bool section_bounds(size_t s, int min[3], int max[3]) const;
+		// Linear indices of the voxels that can have a visible face, in
+		//  ascending order: solid voxels, skipping empty sections and the
+		//  inside of full ones.
+		void candidate_voxels(std::vector<uint32_t> &out) const;
+		// Bytes held by this chunk alone. Shared sections count fully, see
+		//  SectionStore::report for what sharing saves.
+		size_t memory_usage() const;
+
+		Chunk();
+	};
+}
+
+#endif
@@ -0,0 +1,82 @@
+#include <Storage/PaddedChunk.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+constexpr int PaddedChunk::size_x;
+constexpr int PaddedChunk::size_y;
+constexpr int PaddedChunk::size_z;
+constexpr size_t PaddedChunk::size;
+constexpr int PaddedChunk::stride_y;
+constexpr int PaddedChunk::stride_z;
+
+void PaddedChunk::border_region(int dx, int dy, int origin[3], int extent[3]) {
+	origin[0] = dx < 0 ? 0 : dx > 0 ? size_x-1 : 1;
+	origin[1] = dy < 0 ? 0 : dy > 0 ? size_y-1 : 1;
+	origin[2] = 1;
+	extent[0] = dx ? 1 : size_x-2;
+	extent[1] = dy ? 1 : size_y-2;
+	extent[2] = size_z-2;
+}
+
+void PaddedChunk::set_center(const MC::Chunk &center) {
+	static thread_local std::vector<uint8_t> voxels(MC::Chunk::size);
+	center.expand(voxels.data());
+	const uint8_t *row = voxels.data();
+	for(int z=0;z<size_z-2;++z) {
+		for(int y=0;y<size_y-2;++y) {
+			std::memcpy(&m_voxels[index(0, y, z)], row, size_x-2);
+			row += size_x-2;
+		}
+	}
+}
+
+void PaddedChunk::refresh(int dx, int dy, const MC::Chunk *neighbour) {
+	int origin[3], extent[3];
+	border_region(dx, dy, origin, extent);
+	// The border at x = -1 shows x = 15 of the neighbour and so on
+	int x0 = origin[0]-1 - 16*dx;
+	int y0 = origin[1]-1 - 16*dy;
+
+	// Rows of the border along x are extent[0] voxels long, a whole row of
+	//  the neighbours at dx = 0 and a single voxel otherwise
+	uint8_t *border = &m_voxels[index(origin[0]-1, origin[1]-1, 0)];
+	if(neighbour && neighbour->storage == MC::Storage::COLUMN_RLE) {
+		for(int y=0;y<extent[1];++y) {
+			for(int x=0;x<extent[0];++x)
+				neighbour->rle.decode_column(x0+x, y0+y, border + y*stride_y + x, stride_z);
+		}
+		return;
+	}
+	for(int z=0;z<extent[2];++z) {
+		// Missing neighbours and empty sections are air
+		const uint8_t *section = neighbour ? neighbour->sections[z>>4].data() : nullptr;
+		for(int y=0;y<extent[1];++y) {
+			uint8_t *out = border + z*stride_z + y*stride_y;
+			if(!section)
+				std::memset(out, 0, extent[0]);
+			else if(!SectionData::morton)
+				std::memcpy(out, section + SectionData::index(x0, y0+y, z&15), extent[0]);
+			else {
+				for(int x=0;x<extent[0];++x)
+					out[x] = section[SectionData::index(x0+x, y0+y, z&15)];
+			}
+		}
+	}
+}
+
+void PaddedChunk::clear() {
+	std::fill(m_voxels.begin(), m_voxels.end(), 0);
+}
+
+const uint8_t *PaddedChunk::data() const {
+	return m_voxels.data();
+}
+
+uint8_t *PaddedChunk::data() {
+	return m_voxels.data();
+}
+
+PaddedChunk::PaddedChunk():
+	m_voxels(size, 0)
+{;}
@@ -0,0 +1,66 @@
+#ifndef PADDED_CHUNK_HEADER
+#define PADDED_CHUNK_HEADER
+
+#include <Storage/Chunk.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A chunk's voxels in linear order with a one voxel border ("apron") on
+//  every side, holding the facing voxels of the 8 surrounding chunks. Air
+//  stands in for missing neighbours and for everything above and below the
+//  chunk. Kernels that look at neighbouring voxels can step by 1, stride_y
+//  and stride_z from any voxel of the chunk without checking for its edges.
+//
+//  Coordinates are chunk coordinates, x and y go from -1 to 16 and z from
+//  -1 to 256.
+class PaddedChunk
+{
+public:
+	static constexpr int size_x = 16+2;
+	static constexpr int size_y = 16+2;
+	static constexpr int size_z = 256+2;
+	static constexpr size_t size = size_x*size_y*size_z;
+	static constexpr int stride_y = size_x;
+	static constexpr int stride_z = size_x*size_y;
+private:
+	std::vector<uint8_t> m_voxels;
+public:
+	static size_t index(int x, int y, int z) {
+		return (z+1)*stride_z + (y+1)*stride_y + (x+1);
+	}
+	// The part of the border showing the neighbour at (dx, dy), in array
+	//  coordinates starting at 0. Suited for partial texture uploads.
+	static void border_region(int dx, int dy, int origin[3], int extent[3]);
+
+	// Copies the chunk itself, leaving the border alone
+	void set_center(const MC::Chunk &center);
+	// Copies the facing voxels of the neighbour at (dx, dy), both between
+	//  -1 and 1, into the border. A null neighbour is air.
+	void refresh(int dx, int dy, const MC::Chunk *neighbour);
+	// set_center and refresh for all 8 neighbours of the chunk at (x, y).
+	//  chunk_at(x, y) returns the chunk at those coordinates or null for
+	//  missing ones, the one at (x, y) has to be there.
+	template<typename ChunkAt>
+	void fill(int x, int y, const ChunkAt &chunk_at) {
+		set_center(*chunk_at(x, y));
+		for(int dy=-1;dy<=1;++dy) {
+			for(int dx=-1;dx<=1;++dx) {
+				if(dx || dy)
+					refresh(dx, dy, chunk_at(x+dx, y+dy));
+			}
+		}
+	}
+	void clear();
+
+	uint8_t get(int x, int y, int z) const {
+		return m_voxels[index(x, y, z)];
+	}
+	const uint8_t *data() const;
+	uint8_t *data();
+
+	PaddedChunk();
+};
+
+#endif
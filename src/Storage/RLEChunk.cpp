@@ -0,0 +1,108 @@
+#include <Storage/RLEChunk.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+	constexpr int plane = RLEChunk::size_x*RLEChunk::size_y;
+
+	// Transposes a 256x256 byte matrix, switching between z-major voxels and
+	//  one contiguous 256 byte column per (x,y). Going through 16x16 tiles
+	//  keeps both sides in cache.
+	void transpose(const uint8_t *in, uint8_t *out) {
+		static_assert(RLEChunk::size_z == plane, "Chunk must be as tall as a plane is large");
+		for(int tz=0;tz<RLEChunk::size_z;tz+=16) {
+			for(int tc=0;tc<plane;tc+=16) {
+				for(int z=tz;z<tz+16;++z) {
+					for(int c=tc;c<tc+16;++c) {
+						out[c*RLEChunk::size_z + z] = in[z*plane + c];
+					}
+				}
+			}
+		}
+	}
+}
+
+void RLEChunk::encode(const uint8_t *voxels) {
+	static thread_local std::vector<uint8_t> columns_buffer(size_x*size_y*size_z);
+	transpose(voxels, columns_buffer.data());
+
+	m_runs.clear();
+	m_directory.resize(columns+1);
+	for(int c=0;c<columns;++c) {
+		m_directory[c] = m_runs.size();
+		const uint8_t *column = columns_buffer.data() + c*size_z;
+		int z = 0;
+		while(z < size_z) {
+			uint8_t id = column[z];
+			int end = z+1;
+			while(end < size_z && column[end] == id)
+				++end;
+			m_runs.push_back({static_cast<uint8_t>(end-1), id});
+			z = end;
+		}
+	}
+	m_directory[columns] = m_runs.size();
+	m_runs.shrink_to_fit();
+}
+
+void RLEChunk::decode(uint8_t *out) const {
+	if(empty()) {
+		std::memset(out, 0, size_x*size_y*size_z);
+		return;
+	}
+	static thread_local std::vector<uint8_t> columns_buffer(size_x*size_y*size_z);
+	for(int c=0;c<columns;++c) {
+		uint8_t *column = columns_buffer.data() + c*size_z;
+		int z = 0;
+		for(uint32_t r=m_directory[c];r<m_directory[c+1];++r) {
+			std::memset(column+z, m_runs[r].id, m_runs[r].last+1-z);
+			z = m_runs[r].last+1;
+		}
+	}
+	transpose(columns_buffer.data(), out);
+}
+
+uint8_t RLEChunk::get(int x, int y, int z) const {
+	if(empty())
+		return 0;
+	int c = y*size_x + x;
+	auto begin = m_runs.begin() + m_directory[c];
+	auto end = m_runs.begin() + m_directory[c+1];
+	// First run ending at or after z
+	auto run = std::lower_bound(begin, end, z, [](const Run &r, int value) {
+		return r.last < value;
+	});
+	return run->id;
+}
+
+void RLEChunk::decode_column(int x, int y, uint8_t *out, size_t stride) const {
+	if(empty()) {
+		for(int z=0;z<size_z;++z)
+			out[z*stride] = 0;
+		return;
+	}
+	int c = y*size_x + x;
+	int z = 0;
+	for(uint32_t r=m_directory[c];r<m_directory[c+1];++r) {
+		for(;z<=m_runs[r].last;++z)
+			out[z*stride] = m_runs[r].id;
+	}
+}
+
+bool RLEChunk::empty() const {
+	return m_directory.empty();
+}
+
+size_t RLEChunk::run_count() const {
+	return m_runs.size();
+}
+
+size_t RLEChunk::memory_usage() const {
+	return m_runs.capacity()*sizeof(Run) + m_directory.capacity()*sizeof(uint32_t);
+}
+
+void RLEChunk::clear() {
+	m_runs = std::vector<Run>();
+	m_directory = std::vector<uint32_t>();
+}
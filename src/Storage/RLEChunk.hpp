@@ -0,0 +1,46 @@
+#ifndef RLE_CHUNK_HEADER
+#define RLE_CHUNK_HEADER
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Chunk voxels run-length encoded along z, the 256 voxel long axis.
+//  Every one of the 16x16 columns has its own list of runs and the
+//  directory stores where each list starts, so a single voxel is found with
+//  a binary search over its column's runs.
+class RLEChunk
+{
+public:
+	static constexpr int size_x = 16;
+	static constexpr int size_y = 16;
+	static constexpr int size_z = 256;
+	static constexpr int columns = size_x*size_y;
+
+	struct Run {
+		// Last z covered by the run, the first is one past the previous run
+		uint8_t last;
+		uint8_t id;
+	};
+private:
+	std::vector<Run> m_runs;
+	// Runs of column y*16+x are m_runs[m_directory[c]..m_directory[c+1]]
+	std::vector<uint32_t> m_directory;
+public:
+	// Encodes size_x*size_y*size_z voxels indexed z*16*16 + y*16 + x
+	void encode(const uint8_t *voxels);
+	// Decodes all voxels into out, in the same layout encode takes and
+	//  glTexImage3D expects
+	void decode(uint8_t *out) const;
+	uint8_t get(int x, int y, int z) const;
+	// Decodes the size_z voxels of column (x, y) to out, stride apart
+	void decode_column(int x, int y, uint8_t *out, size_t stride) const;
+
+	bool empty() const;
+	size_t run_count() const;
+	// Bytes used by the runs and the directory
+	size_t memory_usage() const;
+	void clear();
+};
+
+#endif
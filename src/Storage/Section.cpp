@@ -0,0 +1,305 @@
+#include <Storage/Section.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+constexpr size_t SectionData::size;
+constexpr bool SectionData::morton;
+
+void SectionData::to_linear(const uint8_t *stored, uint8_t *linear) {
+	if(morton)
+		Morton::to_linear(stored, linear);
+	else
+		std::memcpy(linear, stored, size);
+}
+
+void SectionData::from_linear(const uint8_t *linear, uint8_t *stored) {
+	if(morton)
+		Morton::from_linear(linear, stored);
+	else
+		std::memcpy(stored, linear, size);
+}
+
+void SectionData::summarize() {
+	const uint8_t *linear = voxels.data();
+	uint8_t converted[size];
+	if(morton) {
+		to_linear(voxels.data(), converted);
+		linear = converted;
+	}
+
+	// 16 voxels at a time, four rows make up one word of the mask
+	uint64_t any = 0;
+	uint64_t all = ~0ull;
+	for(size_t word=0;word<size/64;++word) {
+		uint64_t bits = 0;
+		for(int row=0;row<4;++row) {
+			const uint8_t *v = linear + word*64 + row*16;
+#ifdef __SSE2__
+			__m128i ids = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v));
+			uint32_t air = _mm_movemask_epi8(_mm_cmpeq_epi8(ids, _mm_setzero_si128()));
+			uint64_t solid = ~air & 0xFFFF;
+#else
+			uint64_t solid = 0;
+			for(int i=0;i<16;++i)
+				solid |= static_cast<uint64_t>(v[i] != 0) << i;
+#endif
+			bits |= solid << (16*row);
+		}
+		mask[word] = bits;
+		any |= bits;
+		all &= bits;
+	}
+	if(!any)
+		occupancy = Occupancy::EMPTY;
+	else if(all == ~0ull)
+		occupancy = Occupancy::FULL;
+	else
+		occupancy = Occupancy::MIXED;
+
+	// y and z from the rows holding anything, x from all rows combined
+	uint32_t columns = 0;
+	int lo[2] = {16, 16};
+	int hi[2] = {-1, -1};
+	for(int row=0;row<16*16;++row) {
+		uint32_t bits = (mask[row/4] >> (16*(row%4))) & 0xFFFF;
+		if(!bits)
+			continue;
+		columns |= bits;
+		int y = row%16;
+		int z = row/16;
+		lo[0] = std::min(lo[0], y);
+		hi[0] = std::max(hi[0], y);
+		lo[1] = std::min(lo[1], z);
+		hi[1] = std::max(hi[1], z);
+	}
+	if(!columns) {
+		std::memset(bounds_min, 0, sizeof(bounds_min));
+		std::memset(bounds_max, 0, sizeof(bounds_max));
+		return;
+	}
+	bounds_min[0] = __builtin_ctz(columns);
+	bounds_max[0] = 31 - __builtin_clz(columns);
+	bounds_min[1] = lo[0];
+	bounds_max[1] = hi[0];
+	bounds_min[2] = lo[1];
+	bounds_max[2] = hi[1];
+}
+
+SectionData::SectionData():
+	hash{0},
+	interned{false},
+	occupancy{Occupancy::EMPTY},
+	mask{},
+	bounds_min{},
+	bounds_max{},
+	voxels(size, 0)
+{;}
+
+
+const uint8_t *SectionHandle::data() const {
+	if(!m_data)
+		return nullptr;
+	return m_data->voxels.data();
+}
+
+uint8_t SectionHandle::get(size_t index) const {
+	if(!m_data)
+		return 0;
+	return m_data->voxels[index];
+}
+
+uint64_t SectionHandle::hash() const {
+	if(!m_data)
+		return 0;
+	return m_data->hash;
+}
+
+bool SectionHandle::null() const {
+	return !m_data;
+}
+
+Occupancy SectionHandle::occupancy() const {
+	if(!m_data)
+		return Occupancy::EMPTY;
+	return m_data->occupancy;
+}
+
+const uint64_t *SectionHandle::mask() const {
+	if(!m_data)
+		return nullptr;
+	return m_data->mask;
+}
+
+bool SectionHandle::bounds(int min[3], int max[3]) const {
+	if(occupancy() == Occupancy::EMPTY)
+		return false;
+	for(int a=0;a<3;++a) {
+		min[a] = m_data->bounds_min[a];
+		max[a] = m_data->bounds_max[a];
+	}
+	return true;
+}
+
+uint8_t *SectionHandle::mutable_data() {
+	if(!m_data) {
+		m_data = std::make_shared<SectionData>();
+	}
+	else if(m_data->interned || m_data.use_count() > 1) {
+		auto copy = std::make_shared<SectionData>();
+		copy->voxels = m_data->voxels;
+		copy->occupancy = m_data->occupancy;
+		std::memcpy(copy->mask, m_data->mask, sizeof(copy->mask));
+		std::memcpy(copy->bounds_min, m_data->bounds_min, sizeof(copy->bounds_min));
+		std::memcpy(copy->bounds_max, m_data->bounds_max, sizeof(copy->bounds_max));
+		m_data = copy;
+	}
+	return m_data->voxels.data();
+}
+
+void SectionHandle::update_summary() {
+	if(m_data && !m_data->interned)
+		m_data->summarize();
+}
+
+
+bool SectionStore::lookup(uint64_t h, const uint8_t *voxels, SectionHandle &handle) {
+	auto found = m_table.find(h);
+	if(found == m_table.end())
+		return false;
+	auto &bucket = found->second;
+	for(auto it = bucket.begin(); it != bucket.end();) {
+		auto shared = it->lock();
+		if(!shared) {
+			it = bucket.erase(it);
+			--m_entries;
+			continue;
+		}
+		if(!std::memcmp(shared->voxels.data(), voxels, SectionData::size)) {
+			handle.m_data = shared;
+			return true;
+		}
+		++it;
+	}
+	return false;
+}
+
+void SectionStore::sweep() {
+	m_entries = 0;
+	for(auto it = m_table.begin(); it != m_table.end();) {
+		auto &bucket = it->second;
+		bucket.erase(std::remove_if(bucket.begin(), bucket.end(), [](const std::weak_ptr<SectionData> &weak) {
+			return weak.expired();
+		}), bucket.end());
+		if(bucket.empty()) {
+			it = m_table.erase(it);
+			continue;
+		}
+		m_entries += bucket.size();
+		++it;
+	}
+	m_sweep_at = std::max<size_t>(2*m_entries, 1024);
+}
+
+SectionHandle SectionStore::intern(const uint8_t *voxels) {
+	uint64_t h = hash(voxels);
+	SectionHandle handle;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_interned;
+		if(lookup(h, voxels, handle)) {
+			++m_deduplicated;
+			return handle;
+		}
+	}
+
+	// New sections are copied and summarized without holding the lock,
+	//  so another thread may have interned the same voxels meanwhile
+	auto data = std::make_shared<SectionData>();
+	std::memcpy(data->voxels.data(), voxels, SectionData::size);
+	data->hash = h;
+	data->interned = true;
+	data->summarize();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if(lookup(h, voxels, handle)) {
+		++m_deduplicated;
+		return handle;
+	}
+	handle.m_data = data;
+	m_table[h].push_back(data);
+	if(++m_entries >= m_sweep_at)
+		sweep();
+	return handle;
+}
+
+void SectionStore::intern(SectionHandle &handle) {
+	if(!handle.m_data || handle.m_data->interned)
+		return;
+	handle = intern(handle.data());
+}
+
+std::string SectionStore::report() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	uint64_t unique = 0;
+	uint64_t references = 0;
+	for(auto &bucket : m_table) {
+		for(auto &weak : bucket.second) {
+			long count = weak.use_count();
+			if(count > 0) {
+				++unique;
+				references += count;
+			}
+		}
+	}
+	char line[256];
+	std::snprintf(
+		line, sizeof(line),
+		"Sections: %llu references to %llu unique sections, %.1f MiB "
+		"instead of %.1f MiB (%.1fx), %llu of %llu loaded sections shared\n",
+		static_cast<unsigned long long>(references),
+		static_cast<unsigned long long>(unique),
+		unique*SectionData::size/(1024.0*1024.0),
+		references*SectionData::size/(1024.0*1024.0),
+		unique ? static_cast<double>(references)/unique : 0.0,
+		static_cast<unsigned long long>(m_deduplicated),
+		static_cast<unsigned long long>(m_interned)
+	);
+	return line;
+}
+
+uint64_t SectionStore::hash(const uint8_t *voxels) {
+	// 64 bit multiply-rotate hash over whole words, sections are always a
+	//  multiple of 8 bytes long.
+	const uint64_t prime0 = 0x9E3779B185EBCA87ull;
+	const uint64_t prime1 = 0xC2B2AE3D27D4EB4Full;
+	uint64_t h = prime1 ^ SectionData::size;
+	for(size_t i=0;i<SectionData::size;i+=8) {
+		uint64_t word;
+		std::memcpy(&word, voxels+i, 8);
+		word *= prime1;
+		word = (word<<31) | (word>>33);
+		h ^= word*prime0;
+		h = ((h<<27) | (h>>37))*prime0 + prime1;
+	}
+	h ^= h>>33;
+	h *= prime1;
+	h ^= h>>29;
+	return h;
+}
+
+SectionStore &SectionStore::global() {
+	static SectionStore store;
+	return store;
+}
+
+SectionStore::SectionStore():
+	m_entries{0},
+	m_sweep_at{1024},
+	m_interned{0},
+	m_deduplicated{0}
+{;}
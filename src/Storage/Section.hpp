@@ -0,0 +1,126 @@
+#ifndef SECTION_HEADER
+#define SECTION_HEADER
+
+#include <Allocator/SlabAllocator.hpp>
+#include <Layout/Morton.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Whether a section is all air, all solid or a mix of both
+enum class Occupancy : uint8_t {
+	EMPTY,
+	FULL,
+	MIXED
+};
+
+// Voxels of one 16x16x16 section. They are stored in the same z-major
+//  order as a chunk, or in Morton order when built with
+//  VOXELATOR_CHUNK_LAYOUT_MORTON so that all neighbours of a voxel are close
+//  by. Always go through index() and the conversions below.
+struct SectionData {
+	static constexpr size_t size = 16*16*16;
+#ifdef VOXELATOR_CHUNK_LAYOUT_MORTON
+	static constexpr bool morton = true;
+#else
+	static constexpr bool morton = false;
+#endif
+
+	// Position of a voxel within the section, all coordinates below 16
+	static size_t index(int x, int y, int z) {
+		if(morton)
+			return Morton::encode(x, y, z);
+		return z*16*16 + y*16 + x;
+	}
+	// Converts one section between the stored order and the linear order
+	//  used everywhere outside of sections, e.g. for texture uploads
+	static void to_linear(const uint8_t *stored, uint8_t *linear);
+	static void from_linear(const uint8_t *linear, uint8_t *stored);
+
+	// Computes occupancy, mask and bounds from the voxels
+	void summarize();
+
+	uint64_t hash;
+	// Interned sections are shared and must never be written to
+	bool interned;
+	Occupancy occupancy;
+	// One bit per voxel, set for anything but air. Always in linear order,
+	//  so bits 16*(z*16+y) to 16*(z*16+y)+15 are one row along x.
+	uint64_t mask[size/64];
+	// Smallest box holding every solid voxel, both corners inclusive.
+	//  Meaningless for empty sections.
+	uint8_t bounds_min[3];
+	uint8_t bounds_max[3];
+	VoxelBuffer voxels;
+
+	SectionData();
+};
+
+// Reference counted, copy-on-write handle to a section. A null handle
+//  reads as air.
+class SectionHandle
+{
+private:
+	friend class SectionStore;
+	std::shared_ptr<SectionData> m_data;
+public:
+	const uint8_t *data() const;
+	uint8_t get(size_t index) const;
+	// Content hash, only valid for interned sections
+	uint64_t hash() const;
+	bool null() const;
+	// A null handle is empty
+	Occupancy occupancy() const;
+	// SectionData::mask, or nullptr for a null handle
+	const uint64_t *mask() const;
+	// SectionData::bounds_min and bounds_max, false if the section is empty
+	bool bounds(int min[3], int max[3]) const;
+	// Returns writable voxels, copying the section first if it is shared.
+	//  Intern the handle again once done to share it with equal sections,
+	//  or call update_summary if it is to stay unshared.
+	uint8_t *mutable_data();
+	void update_summary();
+};
+
+// Interning table that makes every section with equal contents share one
+//  SectionData. Entries are held weakly, so a section is freed as soon as
+//  its last handle goes away. The expired entries left behind are dropped
+//  when their bucket is searched, and by a sweep over the whole table
+//  whenever it has grown to twice its size after the last one.
+class SectionStore
+{
+private:
+	std::mutex m_mutex;
+	std::unordered_map<uint64_t, std::vector<std::weak_ptr<SectionData>>> m_table;
+	// Entries in m_table, live or expired, and the count to sweep at
+	size_t m_entries;
+	size_t m_sweep_at;
+	uint64_t m_interned;
+	uint64_t m_deduplicated;
+
+	// Looks for a live section with the given voxels, the lock must be held
+	bool lookup(uint64_t h, const uint8_t *voxels, SectionHandle &handle);
+	// Drops every expired entry, the lock must be held
+	void sweep();
+public:
+	// Returns a handle to a section with the given voxels, sharing an
+	//  existing one if the contents match.
+	SectionHandle intern(const uint8_t *voxels);
+	// Shares an edited section with equal sections, if any
+	void intern(SectionHandle &handle);
+
+	// Live references, unique sections and the memory saved by sharing
+	std::string report();
+
+	static uint64_t hash(const uint8_t *voxels);
+	static SectionStore &global();
+
+	SectionStore();
+};
+
+#endif
@@ -0,0 +1,496 @@
+#include <VoxelDAG/VoxelDAG.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+namespace {
+	// Levels of the subtree built for each 16x16x16 section
+	constexpr int section_level = 4;
+	// Chunks turned into subtrees before they are merged into the DAG,
+	//  bounds the memory held by subtrees waiting to be merged.
+	constexpr size_t chunks_per_batch = 256;
+
+	const char file_magic[4] = {'V', 'D', 'A', 'G'};
+	constexpr uint32_t file_version = 1;
+
+	bool uniform(VoxelDAG::NodeRef ref) {
+		return ref & VoxelDAG::uniform_bit;
+	}
+
+	// Intersects the ray with the box [lo, lo+size) on all three axes. Rays
+	//  only grazing an edge or corner miss.
+	bool intersect_box(
+		const float origin[3], const float inverse[3], const int lo[3], int size,
+		float &t_min, float &t_max
+	) {
+		for(int a=0;a<3;++a) {
+			float t0 = (lo[a] - origin[a])*inverse[a];
+			float t1 = (lo[a] + size - origin[a])*inverse[a];
+			if(t0 > t1)
+				std::swap(t0, t1);
+			t_min = std::max(t_min, t0);
+			t_max = std::min(t_max, t1);
+		}
+		return t_min < t_max;
+	}
+}
+
+constexpr VoxelDAG::NodeRef VoxelDAG::uniform_bit;
+
+size_t VoxelDAG::NodeHash::operator()(const Node &node) const {
+	uint64_t h = 0x9E3779B185EBCA87ull;
+	for(auto child : node.children) {
+		h ^= child;
+		h *= 0xC2B2AE3D27D4EB4Full;
+		h ^= h>>29;
+	}
+	return static_cast<size_t>(h);
+}
+
+bool VoxelDAG::NodeEqual::operator()(const Node &a, const Node &b) const {
+	return !std::memcmp(a.children, b.children, sizeof(a.children));
+}
+
+VoxelDAG::NodeRef VoxelDAG::NodeStore::add_leaf(uint64_t voxels) {
+	auto inserted = leaf_table.emplace(voxels, static_cast<NodeRef>(leaves.size()));
+	if(inserted.second)
+		leaves.push_back(voxels);
+	return inserted.first->second;
+}
+
+VoxelDAG::NodeRef VoxelDAG::NodeStore::add_node(int level, const Node &node) {
+	size_t slot = level-2;
+	if(nodes.size() <= slot) {
+		nodes.resize(slot+1);
+		node_tables.resize(slot+1);
+	}
+	auto inserted = node_tables[slot].emplace(node, static_cast<NodeRef>(nodes[slot].size()));
+	if(inserted.second)
+		nodes[slot].push_back(node);
+	return inserted.first->second;
+}
+
+std::vector<VoxelDAG::NodeRef> VoxelDAG::NodeStore::merge(
+	const NodeStore &other, int top_level
+) {
+	// Children always live one level down, so mapping the levels bottom up
+	//  means every child is known by the time its parent is added.
+	std::vector<NodeRef> below(other.leaves.size());
+	for(size_t i=0;i<other.leaves.size();++i)
+		below[i] = add_leaf(other.leaves[i]);
+
+	for(int level=2;level<=top_level;++level) {
+		size_t slot = level-2;
+		std::vector<NodeRef> mapped;
+		if(slot < other.nodes.size()) {
+			mapped.resize(other.nodes[slot].size());
+			for(size_t i=0;i<other.nodes[slot].size();++i) {
+				Node node = other.nodes[slot][i];
+				for(auto &child : node.children) {
+					if(!uniform(child))
+						child = below[child];
+				}
+				mapped[i] = add_node(level, node);
+			}
+		}
+		below.swap(mapped);
+	}
+	return below;
+}
+
+void VoxelDAG::NodeStore::clear_tables() {
+	leaf_table = std::unordered_map<uint64_t, NodeRef>();
+	node_tables.clear();
+}
+
+
+VoxelDAG::NodeRef VoxelDAG::build_cube(
+	NodeStore &store, const uint8_t *voxels, int level, int x0, int y0, int z0
+) {
+	int half = 1<<(level-1);
+	if(level == 1) {
+		uint64_t packed = 0;
+		for(int c=0;c<8;++c) {
+			int x = x0 + (c&1);
+			int y = y0 + ((c>>1)&1);
+			int z = z0 + ((c>>2)&1);
+			packed |= static_cast<uint64_t>(voxels[z*16*16 + y*16 + x]) << (8*c);
+		}
+		uint8_t first = packed & 0xFF;
+		if(packed == first*0x0101010101010101ull)
+			return uniform_bit | first;
+		return store.add_leaf(packed);
+	}
+
+	Node node;
+	bool collapse = true;
+	for(int c=0;c<8;++c) {
+		node.children[c] = build_cube(
+			store, voxels, level-1,
+			x0 + (c&1)*half, y0 + ((c>>1)&1)*half, z0 + ((c>>2)&1)*half
+		);
+		collapse = collapse && uniform(node.children[c]) && node.children[c] == node.children[0];
+	}
+	if(collapse)
+		return node.children[0];
+	return store.add_node(level, node);
+}
+
+void VoxelDAG::build(const MapLoader &map, JobSystem &jobs) {
+	clear();
+
+	struct ChunkEntry {
+		const MC::Chunk *chunk;
+		int x, y;
+	};
+	std::vector<ChunkEntry> chunks;
+	for(size_t rx=0;rx<map.regions.size();++rx) {
+		for(size_t ry=0;ry<map.regions[rx].size();++ry) {
+			const MC::Region &region = map.regions[rx][ry];
+			for(int i=0;i<1024;++i) {
+				if(!region.chunks[i].loaded)
+					continue;
+				ChunkEntry entry;
+				entry.chunk = &region.chunks[i];
+				entry.x = rx*32 + i%32;
+				entry.y = ry*32 + i/32;
+				m_chunks_x = std::max(m_chunks_x, entry.x+1);
+				m_chunks_y = std::max(m_chunks_y, entry.y+1);
+				chunks.push_back(entry);
+			}
+		}
+	}
+
+	if(chunks.empty())
+		return;
+
+	// Section subtrees on a grid of cells, 16 cells high
+	size_t cells_x = m_chunks_x;
+	size_t cells_y = m_chunks_y;
+	size_t cells_z = MC::Chunk::section_count;
+	std::vector<NodeRef> cells(cells_x*cells_y*cells_z, uniform_bit);
+
+	for(size_t batch=0;batch<chunks.size();batch+=chunks_per_batch) {
+		size_t batch_end = std::min(chunks.size(), batch+chunks_per_batch);
+		std::vector<std::unique_ptr<NodeStore>> stores(batch_end-batch);
+		std::vector<NodeRef> roots((batch_end-batch)*cells_z);
+		jobs.parallel_for(batch, batch_end, 1, [&](size_t i) {
+			static thread_local VoxelBuffer voxels(MC::Chunk::size);
+			chunks[i].chunk->expand(voxels.data());
+			std::unique_ptr<NodeStore> store(new NodeStore);
+			for(size_t s=0;s<cells_z;++s) {
+				roots[(i-batch)*cells_z + s] = build_cube(
+					*store, voxels.data() + s*SectionData::size, section_level, 0, 0, 0
+				);
+			}
+			stores[i-batch] = std::move(store);
+		});
+
+		for(size_t i=batch;i<batch_end;++i) {
+			std::vector<NodeRef> mapped = m_store.merge(*stores[i-batch], section_level);
+			stores[i-batch].reset();
+			for(size_t s=0;s<cells_z;++s) {
+				NodeRef ref = roots[(i-batch)*cells_z + s];
+				if(!uniform(ref))
+					ref = mapped[ref];
+				cells[(s*cells_y + chunks[i].y)*cells_x + chunks[i].x] = ref;
+			}
+		}
+	}
+
+	// Pair up cells level by level until a single one is left, anything
+	//  past the edge of the map is air.
+	m_depth = section_level;
+	while(cells_x > 1 || cells_y > 1 || cells_z > 1) {
+		size_t next_x = (cells_x+1)/2;
+		size_t next_y = (cells_y+1)/2;
+		size_t next_z = (cells_z+1)/2;
+		std::vector<NodeRef> next(next_x*next_y*next_z);
+		++m_depth;
+		for(size_t z=0;z<next_z;++z) {
+			for(size_t y=0;y<next_y;++y) {
+				for(size_t x=0;x<next_x;++x) {
+					Node node;
+					bool collapse = true;
+					for(int c=0;c<8;++c) {
+						size_t cx = 2*x + (c&1);
+						size_t cy = 2*y + ((c>>1)&1);
+						size_t cz = 2*z + ((c>>2)&1);
+						NodeRef ref = uniform_bit;
+						if(cx < cells_x && cy < cells_y && cz < cells_z)
+							ref = cells[(cz*cells_y + cy)*cells_x + cx];
+						node.children[c] = ref;
+						collapse = collapse && uniform(ref) && ref == node.children[0];
+					}
+					next[(z*next_y + y)*next_x + x] = collapse
+						? node.children[0]
+						: m_store.add_node(m_depth, node);
+				}
+			}
+		}
+		cells.swap(next);
+		cells_x = next_x;
+		cells_y = next_y;
+		cells_z = next_z;
+	}
+	m_root = cells[0];
+	m_store.nodes.resize(m_depth-1);
+	m_store.clear_tables();
+}
+
+void VoxelDAG::clear() {
+	m_store = NodeStore();
+	m_root = uniform_bit;
+	m_depth = 0;
+	m_chunks_x = 0;
+	m_chunks_y = 0;
+}
+
+uint8_t VoxelDAG::get(int x, int y, int z) const {
+	if(x < 0 || y < 0 || z < 0 || x >= 16*m_chunks_x || y >= 16*m_chunks_y || z >= 256)
+		return 0;
+	NodeRef ref = m_root;
+	for(int level=m_depth;level>=1;--level) {
+		if(uniform(ref))
+			return ref & 0xFF;
+		int shift = level-1;
+		int c = ((x>>shift)&1) | (((y>>shift)&1)<<1) | (((z>>shift)&1)<<2);
+		if(level == 1)
+			return (m_store.leaves[ref] >> (8*c)) & 0xFF;
+		ref = m_store.nodes[level-2][ref].children[c];
+	}
+	return ref & 0xFF;
+}
+
+bool VoxelDAG::raycast_node(
+	NodeRef ref, int level, int x0, int y0, int z0,
+	const float origin[3], const float inverse[3], const float direction[3],
+	float t_min, float t_max, Hit &hit
+) const {
+	if(uniform(ref)) {
+		uint8_t id = ref & 0xFF;
+		if(!id)
+			return false;
+		// Step slightly into the node so the voxel is the one entered, not
+		//  the one left behind.
+		int lo[3] = {x0, y0, z0};
+		int voxel[3];
+		for(int a=0;a<3;++a) {
+			float p = origin[a] + direction[a]*t_min;
+			int v = static_cast<int>(std::floor(p + (direction[a] < 0 ? -1e-3f : 1e-3f)));
+			voxel[a] = std::min(std::max(v, lo[a]), lo[a] + (1<<level) - 1);
+		}
+		hit.distance = t_min;
+		hit.x = voxel[0];
+		hit.y = voxel[1];
+		hit.z = voxel[2];
+		hit.id = id;
+		return true;
+	}
+
+	// Visiting children in index order mirrored by the ray's direction is
+	//  front to back: two children the ray passes through can only be
+	//  entered in the order of their mirrored index.
+	int mirror = (direction[0] < 0 ? 1 : 0) | (direction[1] < 0 ? 2 : 0) | (direction[2] < 0 ? 4 : 0);
+	int half = 1<<(level-1);
+	for(int i=0;i<8;++i) {
+		int c = i ^ mirror;
+		int lo[3] = {x0 + (c&1)*half, y0 + ((c>>1)&1)*half, z0 + ((c>>2)&1)*half};
+		float child_min = t_min;
+		float child_max = t_max;
+		if(!intersect_box(origin, inverse, lo, half, child_min, child_max))
+			continue;
+		NodeRef child;
+		if(level == 1)
+			child = uniform_bit | ((m_store.leaves[ref] >> (8*c)) & 0xFF);
+		else
+			child = m_store.nodes[level-2][ref].children[c];
+		if(raycast_node(
+			child, level-1, lo[0], lo[1], lo[2],
+			origin, inverse, direction, child_min, child_max, hit
+		))
+			return true;
+	}
+	return false;
+}
+
+bool VoxelDAG::raycast(
+	const float origin[3], const float direction[3], float max_distance,
+	Hit &hit
+) const {
+	if(!m_depth)
+		return false;
+	// Rays parallel to an axis get a huge but finite inverse, so that
+	//  0*inverse stays 0 instead of becoming NaN.
+	float inverse[3];
+	for(int a=0;a<3;++a) {
+		if(std::fabs(direction[a]) > 1e-20f)
+			inverse[a] = 1.0f/direction[a];
+		else
+			inverse[a] = direction[a] < 0 ? -1e30f : 1e30f;
+	}
+	int lo[3] = {0, 0, 0};
+	float t_min = 0.0f;
+	float t_max = max_distance;
+	if(!intersect_box(origin, inverse, lo, 1<<m_depth, t_min, t_max))
+		return false;
+	return raycast_node(m_root, m_depth, 0, 0, 0, origin, inverse, direction, t_min, t_max, hit);
+}
+
+bool VoxelDAG::serialize(const std::string &filename) const {
+	std::ofstream file(filename, std::ios::binary | std::ios::out);
+	if(!file.is_open())
+		return false;
+
+	auto write = [&](const void *data, size_t bytes) {
+		file.write(static_cast<const char*>(data), bytes);
+	};
+	int32_t header[4] = {m_depth, m_chunks_x, m_chunks_y, static_cast<int32_t>(m_store.nodes.size())};
+	write(file_magic, sizeof(file_magic));
+	write(&file_version, sizeof(file_version));
+	write(header, sizeof(header));
+	write(&m_root, sizeof(m_root));
+
+	uint64_t count = m_store.leaves.size();
+	write(&count, sizeof(count));
+	write(m_store.leaves.data(), count*sizeof(uint64_t));
+	for(auto &level : m_store.nodes) {
+		count = level.size();
+		write(&count, sizeof(count));
+		write(level.data(), count*sizeof(Node));
+	}
+	return static_cast<bool>(file);
+}
+
+bool VoxelDAG::deserialize(const std::string &filename) {
+	clear();
+	std::ifstream file(filename, std::ios::binary | std::ios::in);
+	if(!file.is_open())
+		return false;
+
+	auto read = [&](void *data, size_t bytes) {
+		file.read(static_cast<char*>(data), bytes);
+		return static_cast<bool>(file);
+	};
+	char magic[4];
+	uint32_t version;
+	int32_t header[4];
+	NodeStore store;
+	NodeRef root;
+	if(!read(magic, sizeof(magic)) || std::memcmp(magic, file_magic, sizeof(magic)))
+		return false;
+	if(!read(&version, sizeof(version)) || version != file_version)
+		return false;
+	if(!read(header, sizeof(header)) || !read(&root, sizeof(root)))
+		return false;
+	int depth = header[0];
+	int level_count = header[3];
+	if(depth < 1 || depth > 30 || level_count != depth-1 || header[1] < 0 || header[2] < 0)
+		return false;
+
+	// Counts come from the file, so grow while reading instead of trusting
+	//  them with one huge allocation.
+	auto read_array = [&](auto &out) {
+		uint64_t count;
+		if(!read(&count, sizeof(count)))
+			return false;
+		const uint64_t step = 1<<16;
+		for(uint64_t done=0;done<count;done+=step) {
+			uint64_t n = std::min(step, count-done);
+			out.resize(done+n);
+			if(!read(&out[done], n*sizeof(out[0])))
+				return false;
+		}
+		return true;
+	};
+	if(!read_array(store.leaves))
+		return false;
+	store.nodes.resize(level_count);
+	for(auto &level : store.nodes) {
+		if(!read_array(level))
+			return false;
+	}
+
+	// Every reference has to point at an existing node one level down
+	auto valid = [&](NodeRef ref, int level) {
+		if(uniform(ref))
+			return (ref & ~uniform_bit) < 256;
+		if(level == 1)
+			return ref < store.leaves.size();
+		return ref < store.nodes[level-2].size();
+	};
+	if(!valid(root, depth))
+		return false;
+	for(int level=2;level<=depth;++level) {
+		for(auto &node : store.nodes[level-2]) {
+			for(auto child : node.children) {
+				if(!valid(child, level-1))
+					return false;
+			}
+		}
+	}
+
+	m_store = std::move(store);
+	m_root = root;
+	m_depth = depth;
+	m_chunks_x = header[1];
+	m_chunks_y = header[2];
+	return true;
+}
+
+int VoxelDAG::depth() const {
+	return m_depth;
+}
+
+int VoxelDAG::chunks_x() const {
+	return m_chunks_x;
+}
+
+int VoxelDAG::chunks_y() const {
+	return m_chunks_y;
+}
+
+size_t VoxelDAG::node_count() const {
+	size_t count = m_store.leaves.size();
+	for(auto &level : m_store.nodes)
+		count += level.size();
+	return count;
+}
+
+size_t VoxelDAG::memory_usage() const {
+	size_t bytes = m_store.leaves.size()*sizeof(uint64_t);
+	for(auto &level : m_store.nodes)
+		bytes += level.size()*sizeof(Node);
+	return bytes;
+}
+
+std::string VoxelDAG::report() const {
+	std::string out;
+	char line[256];
+	std::snprintf(line, sizeof(line), "DAG: depth %d, %zu leaves", m_depth, m_store.leaves.size());
+	out += line;
+	for(size_t i=0;i<m_store.nodes.size();++i) {
+		std::snprintf(line, sizeof(line), ", %zu at level %zu", m_store.nodes[i].size(), i+2);
+		out += line;
+	}
+	double raw = static_cast<double>(m_chunks_x)*m_chunks_y*MC::Chunk::size;
+	std::snprintf(
+		line, sizeof(line),
+		"\n%.2f MiB for a %dx%d chunk map, %.1f MiB as plain voxels (%.1fx)\n",
+		memory_usage()/(1024.0*1024.0), m_chunks_x, m_chunks_y,
+		raw/(1024.0*1024.0), memory_usage() ? raw/memory_usage() : 0.0
+	);
+	out += line;
+	return out;
+}
+
+VoxelDAG::VoxelDAG():
+	m_root{uniform_bit},
+	m_depth{0},
+	m_chunks_x{0},
+	m_chunks_y{0}
+{;}
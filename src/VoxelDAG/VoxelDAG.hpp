@@ -0,0 +1,111 @@
+#ifndef VOXEL_DAG
+#define VOXEL_DAG
+
+#include <MapLoader/MapLoader.hpp>
+#include <Jobs/JobSystem.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Sparse voxel octree over a whole loaded map, with identical subtrees
+//  merged into one so it becomes a directed acyclic graph. Subtrees made of
+//  a single block id are not stored at all, their parent refers to them by
+//  id.
+//
+//  Coordinates are world voxels laid out like the chunks: chunk (cx, cy) of
+//  the map covers x in [16*cx, 16*cx+16), y in [16*cy, 16*cy+16) and all of
+//  z in [0, 256), with z pointing down.
+class VoxelDAG
+{
+public:
+	// Either the index of a node one level down, or uniform_bit | block id
+	//  for a subtree filled with a single block.
+	using NodeRef = uint32_t;
+	static constexpr NodeRef uniform_bit = 0x80000000u;
+
+	// Child c covers the octant x = c&1, y = (c>>1)&1, z = (c>>2)&1
+	struct Node {
+		NodeRef children[8];
+	};
+
+	struct Hit {
+		float distance;
+		int x, y, z;
+		uint8_t id;
+	};
+private:
+	// Deduplicating node storage. Level 1 nodes are 2x2x2 voxels packed
+	//  into one word, byte c holding child c. Level l > 1 nodes are in
+	//  nodes[l-2].
+	struct NodeHash {
+		size_t operator()(const Node &node) const;
+	};
+	struct NodeEqual {
+		bool operator()(const Node &a, const Node &b) const;
+	};
+	struct NodeStore {
+		std::vector<uint64_t> leaves;
+		std::vector<std::vector<Node>> nodes;
+		std::unordered_map<uint64_t, NodeRef> leaf_table;
+		std::vector<std::unordered_map<Node, NodeRef, NodeHash, NodeEqual>> node_tables;
+
+		NodeRef add_leaf(uint64_t voxels);
+		NodeRef add_node(int level, const Node &node);
+		// Adds every node of other, returns where other's top level nodes
+		//  ended up.
+		std::vector<NodeRef> merge(const NodeStore &other, int top_level);
+		void clear_tables();
+	};
+
+	NodeStore m_store;
+	NodeRef m_root;
+	// The root covers 2^m_depth voxels along each axis
+	int m_depth;
+	int m_chunks_x;
+	int m_chunks_y;
+
+	static NodeRef build_cube(
+		NodeStore &store, const uint8_t *voxels, int level, int x0, int y0, int z0
+	);
+	bool raycast_node(
+		NodeRef ref, int level, int x0, int y0, int z0,
+		const float origin[3], const float inverse[3], const float direction[3],
+		float t_min, float t_max, Hit &hit
+	) const;
+public:
+	// Replaces the contents with every loaded chunk of map. Chunks are
+	//  turned into subtrees in parallel on jobs and merged in a fixed
+	//  order, so the result does not depend on the number of workers.
+	void build(const MapLoader &map, JobSystem &jobs = JobSystem::global());
+	void clear();
+
+	// Block id at a voxel, air outside the map
+	uint8_t get(int x, int y, int z) const;
+	// Finds the first non-air voxel along the ray within max_distance.
+	//  direction does not have to be normalised, distance is measured in
+	//  multiples of it.
+	bool raycast(
+		const float origin[3], const float direction[3], float max_distance,
+		Hit &hit
+	) const;
+
+	// Compact binary form, in host byte order
+	bool serialize(const std::string &filename) const;
+	bool deserialize(const std::string &filename);
+
+	int depth() const;
+	int chunks_x() const;
+	int chunks_y() const;
+	size_t node_count() const;
+	// Bytes used by the nodes once built
+	size_t memory_usage() const;
+	// Node counts per level and memory compared to plain voxels
+	std::string report() const;
+
+	VoxelDAG();
+};
+
+#endif
@@ -10,6 +10,14 @@
 #include "Program/Program.hpp"
 #include "Util/Util.hpp"
 #include "MapLoader/MapLoader.hpp"
+#include "Pipeline/LoadPipeline.hpp"
+#include "Jobs/JobSystem.hpp"
+#include "Allocator/SlabAllocator.hpp"
+#include "Allocator/GeometryHeap.hpp"
+#include "Storage/PaddedChunk.hpp"
+#include "Mesher/Mesher.hpp"
+#include "Edit/EditTracker.hpp"
+#include "MeshCache/MeshCache.hpp"
 #include "Light/Light.hpp"
 #include <thread>
 #include <vector>
@@ -22,6 +30,7 @@
 #include <array>
 #include <ctime>
 #include <random>
+#include <cstring>
 #include "ext/stb/stb_image.h"
 #include "ext/stb/stb_image_write.h"
 #include "ext/json/src/json.hpp"
@@ -39,11 +48,16 @@ constexpr const_vec<int32_t> num_chunks(16, 16, 1);
 // Specify chunk sizes, chunk_size_*  and chunk_total must be a power of 2.
 constexpr const_vec<int32_t> chunk_size(16, 16, 256);
 constexpr uint64_t chunk_total =chunk_size.x*chunk_size.y*chunk_size.z;
-constexpr const_vec<int> chunk_grouping(4, 4, 1);
 
 constexpr const_vec<int> block_offset(0, sizeof(coord_type), 2*sizeof(coord_type));
 
-constexpr GLsizei components_per_vtx = 9;
+// Chunk meshes are lists of Mesher::Quad records, which the render vertex
+//  shader expands into 4 vertices and the quad index buffer into 2
+//  triangles each
+constexpr GLsizeiptr quad_bytes = sizeof(Mesher::Quad);
+constexpr GLsizei indices_per_quad = 6;
+// Quads of each geometry heap page, 16 MiB buffers
+constexpr uint32_t heap_page_quads = 1u << 21;
 
 // Camera struct
 struct camera {
@@ -87,27 +101,44 @@ struct block{
 
 // A chunk contains a static array of blocks
 //  (each chunk has the same blocks, with different IDs)
-// It also contains its texture ID and an array of block IDs (which go into the
-//    textures)
+// It also contains its block IDs, stored as shared sections, and the slot
+//    they were uploaded to in the world ID texture
 struct chunk{
 	static std::vector<block> offsets;
 	glm::ivec3 position;
-	std::vector<block_id> *IDs;
-	GLenum texnum;
-	GLuint texid;
-	GLuint tex;
-	GLuint buffer_geometry;
-	GLuint primitive_count;
-	GLuint vertex_count;
-	GLuint component_count;
-	GLuint vtx_array;
-	bool draw;
+	MC::Chunk *IDs;
+	// -1 until uploaded
+	GLint slot;
+	GeometryHeap::Handle geometry;
+	GLuint quad_count;
+	// Host copy of the quads of an edited chunk, see EditTracker
+	std::vector<Mesher::Quad> quads;
+	bool edited;
+	// The chunk's quads are sorted by direction and section,
+	//  range_quads[n][s] of them face direction n in section s
+	GLuint range_quads[Mesher::directions][Mesher::sections];
+	// Box around each section's solid blocks relative to the chunk's
+	//  origin, used for culling. bounds_min > bounds_max if there are none.
+	glm::vec3 bounds_min[Mesher::sections];
+	glm::vec3 bounds_max[Mesher::sections];
 };
 
-struct chunk_group {
-	std::vector<chunk*> chunks;
-	GLuint merged_geometry;
-	GLuint vtx_array;
+// Layout of the commands glMultiDrawElementsIndirect reads
+struct draw_command {
+	GLuint count;
+	GLuint instance_count;
+	GLuint first_index;
+	GLint base_vertex;
+	GLuint base_instance;
+};
+
+// Where a chunk's quads are for the cull shader, see Chunk there
+struct cull_chunk {
+	GLuint page;
+	GLuint first_quad;
+	GLuint quad_count;
+	GLuint padding;
+	GLuint range_quads[Mesher::directions][Mesher::sections];
 };
 
 std::vector<block> chunk::offsets;
@@ -123,8 +154,26 @@ int cleanup(int rtval, std::wstring extra=L"");
 bool readfile(const char* filename, std::string &contents);
 bool process_gl_errors();
 
-int main()
+int main(int argc, char **argv)
 {
+	// -mesher selects how chunk meshes are built: gpu with the generate
+	//  geometry shader (the default), compute with the generate compute
+	//  shader, or cpu with the CPU greedy mesher. -mesh-cache names the
+	//  file meshes are kept in between runs, none turns it off.
+	//  -occlusion off culls sections by the frustum only.
+	std::string mesher = "gpu";
+	std::string mesh_cache_file = "./assets/mesh_cache.vmc";
+	bool occlusion_culling = true;
+	for(int i=1;i<argc;++i) {
+		if(!std::strcmp(argv[i], "-mesher") && i+1<argc)
+			mesher = argv[++i];
+		else if(!std::strcmp(argv[i], "-mesh-cache") && i+1<argc)
+			mesh_cache_file = argv[++i];
+		else if(!std::strcmp(argv[i], "-occlusion") && i+1<argc)
+			occlusion_culling = std::strcmp(argv[++i], "off") != 0;
+	}
+	bool cpu_mesher = mesher == "cpu";
+	bool compute_mesher = mesher == "compute";
 
 	// Generate chunk_x*chunk_y chunks
 	std::vector<std::vector<chunk>> chunks(num_chunks.x);
@@ -186,6 +235,13 @@ int main()
 	if(glewInit())
 		return cleanup(-3);
 
+	// Draw commands pick each chunk's origin by their base instance, and the
+	//  cull shader writes how many of them there are
+	if(!GLEW_ARB_shader_draw_parameters)
+		return cleanup(-6, L"GL_ARB_shader_draw_parameters");
+	if(!GLEW_ARB_indirect_parameters)
+		return cleanup(-6, L"GL_ARB_indirect_parameters");
+
 	process_gl_errors();
 
 	wlog.log(
@@ -217,27 +273,35 @@ int main()
 	Program generate_program;
 	generate_program.attach(shader_generate_vert);
 	generate_program.attach(shader_generate_geom);
-	generate_program.transform_feedback_varyings({"gPos", "gTexcoords", "gNormal"});
+	generate_program.transform_feedback_varyings({"gQuad"});
 	generate_program.link();
 
+	Program generate_compute_program;
+	if(compute_mesher) {
+		wlog.log(L"Creating and linking generate compute shader program.\n");
+		Shader shader_generate_comp;
+		shader_generate_comp.load_file(GL_COMPUTE_SHADER, "assets/shaders/generate/shader.comp");
+		generate_compute_program.attach(shader_generate_comp);
+		generate_compute_program.link();
+	}
 
-	wlog.log(L"Creating frustum_culling vertex shader.\n");
-	Shader shader_frustum_culling_vert;
-	shader_frustum_culling_vert.load_file(GL_VERTEX_SHADER, "assets/shaders/frustum_culling/shader.vert");
 
-	wlog.log(L"Creating frustum_culling geometry shader.\n");
-	Shader shader_frustum_culling_geom;
-	shader_frustum_culling_geom.load_file(GL_GEOMETRY_SHADER, "assets/shaders/frustum_culling/shader.geom");
+	wlog.log(L"Creating and linking cull compute shader program.\n");
+	Shader shader_cull_comp;
+	shader_cull_comp.load_file(GL_COMPUTE_SHADER, "assets/shaders/cull/shader.comp");
 
-	wlog.log(L"Creating and linking frustum_culling shader program.\n");
+	Program cull_program;
+	cull_program.attach(shader_cull_comp);
+	cull_program.link();
 
-	Program frustum_culling_program;
-	frustum_culling_program.attach(shader_frustum_culling_vert);
-	frustum_culling_program.attach(shader_frustum_culling_geom);
-	frustum_culling_program.transform_feedback_varyings({"gPos"});
-	frustum_culling_program.link();
+	wlog.log(L"Creating and linking hiz compute shader program.\n");
+	Shader shader_hiz_comp;
+	shader_hiz_comp.load_file(GL_COMPUTE_SHADER, "assets/shaders/hiz/shader.comp");
+
+	Program hiz_program;
+	hiz_program.attach(shader_hiz_comp);
+	hiz_program.link();
 
-	
 	wlog.log(L"Creating render vertex shader.\n");
 	Shader shader_render_vert;
 	shader_render_vert.load_file(GL_VERTEX_SHADER, "assets/shaders/render/shader.vert");
@@ -378,29 +442,40 @@ int main()
 	);
 	process_gl_errors();
 
-	chunk empty_chunk;
-	empty_chunk.buffer_geometry=-1;
-	empty_chunk.component_count=-1;
-	empty_chunk.primitive_count=-1;
-	empty_chunk.vertex_count=-1;
-	empty_chunk.vtx_array=-1;
-	empty_chunk.IDs = new std::vector<block_id>(chunk_total);
-	std::fill(empty_chunk.IDs->begin(), empty_chunk.IDs->end(), 0);
-	empty_chunk.tex = 0;
-	empty_chunk.texnum = GL_TEXTURE0;
-	glActiveTexture(empty_chunk.texnum);
-	glGenTextures(1, &empty_chunk.texid);
-	glBindTexture(GL_TEXTURE_3D, empty_chunk.texid);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// Scratch space chunk sections are expanded into for uploading
+	VoxelBuffer upload_buffer(chunk_total, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	// The block IDs of all chunks live in one texture, each chunk in a slot
+	//  of chunk_size, laid out world_slots_x to a row. chunk_slots maps
+	//  chunk (x, y) at x*num_chunks.y + y to its slot, or -1 while it isn't
+	//  uploaded, and is mirrored in chunk_slots_buffer. The generate
+	//  shaders look up any block of the world through it, across chunk
+	//  edges and without rebinding anything per chunk.
+	const GLint world_slots_x = num_chunks.x;
+	const GLint world_slots_y = num_chunks.y;
+	GLint next_slot = 0;
+	std::vector<GLint> chunk_slots(num_chunks.x*num_chunks.y, -1);
+	GLuint world_ids;
+	glActiveTexture(GL_TEXTURE1);
+	glGenTextures(1, &world_ids);
+	glBindTexture(GL_TEXTURE_3D, world_ids);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, 0);
-	glTexParameterfv(GL_TEXTURE_3D, GL_TEXTURE_BORDER_COLOR, col);
-	glTexImage3D(
-		GL_TEXTURE_3D, 0, GL_RED, chunk_size.x, chunk_size.y, 
-		chunk_size.z, 0, GL_RED, GL_UNSIGNED_BYTE, 
-		empty_chunk.IDs->data()
+	glTexStorage3D(
+		GL_TEXTURE_3D, 1, GL_R8UI, chunk_size.x*world_slots_x,
+		chunk_size.y*world_slots_y, chunk_size.z
 	);
-	glGenerateMipmap(GL_TEXTURE_3D);
+	GLuint chunk_slots_buffer;
+	glGenBuffers(1, &chunk_slots_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, chunk_slots_buffer);
+	glBufferData(
+		GL_SHADER_STORAGE_BUFFER, sizeof(GLint)*chunk_slots.size(),
+		chunk_slots.data(), GL_DYNAMIC_DRAW
+	);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, chunk_slots_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
 	std::random_device rd;
 	std::default_random_engine rd_engine(rd());
@@ -409,66 +484,155 @@ int main()
 	wlog.log(L"Loading maps.\n");
 
 	MapLoader map;
-	map.load("./assets/minecraft/region/r.0.0.mca", 0, 0);
-	wlog.log(L"Loaded map (0,0).\n");
-	// map.load("./assets/minecraft/region/r.1.0.mca", 1, 0);
-	// wlog.log(L"Loaded map (1,0).\n");
-	// map.load("./assets/minecraft/region/r.0.1.mca", 0, 1);
-	// wlog.log(L"Loaded map (0,1).\n");
-	// map.load("./assets/minecraft/region/r.1.1.mca", 1, 1);
-	// wlog.log(L"Loaded map (1,1).\n");
+	LoadPipeline load_pipeline(map);
+	load_pipeline.add_region("./assets/minecraft/region/r.0.0.mca", 0, 0);
+	// load_pipeline.add_region("./assets/minecraft/region/r.1.0.mca", 1, 0);
+	// load_pipeline.add_region("./assets/minecraft/region/r.0.1.mca", 0, 1);
+	// load_pipeline.add_region("./assets/minecraft/region/r.1.1.mca", 1, 1);
+	load_pipeline.start();
 
 	wlog.log(L"Creating Chunk Info Textures.\n");
 
 	for(unsigned int x=0;x<chunks.size();++x) {
 		for(unsigned int y=0;y<chunks[x].size();++y) {
-			chunks[x][y].tex = 1;
-			chunks[x][y].texnum = GL_TEXTURE0 + 1;
 			chunks[x][y].position = glm::vec3(x, y, 0.f);
+			chunks[x][y].slot = -1;
+		}
+	}
 
-			if(map.regions[x/32][y/32].chunks[(y%32)*32+(x%32)].loaded) {
-				chunks[x][y].IDs = &map.regions[x/32][y/32].chunks[(y%32)*32+(x%32)].blocks;
-			}
+	auto neighbour_ids = [&](int x, int y) -> const MC::Chunk* {
+		if(x < 0 || y < 0 || x >= num_chunks.x || y >= num_chunks.y)
+			return nullptr;
+		return chunks[x][y].IDs;
+	};
 
-			else {
-				chunks[x][y].IDs = new std::vector<block_id>(chunk_total);
-				for(int _z=0;_z<chunk_size.z;++_z) {
-					for(int _y=0;_y<chunk_size.y;++_y) {
-						for(int _x=0;_x<chunk_size.x;++_x) {
-							int height = abs(_x-(chunk_size.x/2)) 
-							           + abs(_y-(chunk_size.y/2));
-							size_t index = _z*chunk_size.x*chunk_size.y
-							             + _y*chunk_size.x
-							             + _x;
-							(*chunks[x][y].IDs)[index] =
-								(_z>height)?dist(rd_engine):0;
-						}
-					}
+	// Copies a chunk's IDs into the next free slot of the world ID texture
+	auto upload_chunk_ids = [&](int x, int y) {
+		chunk &c = chunks[x][y];
+		c.slot = next_slot++;
+		c.IDs->expand(upload_buffer.data());
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_3D, world_ids);
+		glTexSubImage3D(
+			GL_TEXTURE_3D, 0, (c.slot%world_slots_x)*chunk_size.x,
+			(c.slot/world_slots_x)*chunk_size.y, 0, chunk_size.x, chunk_size.y,
+			chunk_size.z, GL_RED_INTEGER, GL_UNSIGNED_BYTE, upload_buffer.data()
+		);
+		size_t index = x*num_chunks.y + y;
+		chunk_slots[index] = c.slot;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, chunk_slots_buffer);
+		glBufferSubData(
+			GL_SHADER_STORAGE_BUFFER, sizeof(GLint)*index, sizeof(GLint),
+			&chunk_slots[index]
+		);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	};
+
+	// Upload chunks as the pipeline finishes them, the GL context lives on
+	//  this thread. It has nothing else to do meanwhile, so it sleeps
+	//  until chunks arrive.
+	while(!load_pipeline.finished()) {
+		load_pipeline.poll_wait(
+			[&](int region_x, int region_y, uint32_t index, MC::Chunk &mc) {
+				unsigned int x = region_x*32 + index%32;
+				unsigned int y = region_y*32 + index/32;
+				if(x >= chunks.size() || y >= chunks[x].size())
+					return;
+				chunks[x][y].IDs = &mc;
+				upload_chunk_ids(x, y);
+			}, 16
+		);
+	}
+	{
+		std::string report = load_pipeline.report();
+		wlog.log(std::wstring(report.begin(), report.end()));
+	}
+	wlog.log(L"Loaded maps.\n");
+
+	// Generate terrain for every chunk the maps didn't cover. Filling the IDs
+	//  runs on the job system, only the uploads have to stay on this thread.
+	std::vector<chunk*> generated_chunks;
+	std::vector<unsigned int> generated_seeds;
+	std::vector<MC::Chunk> generated_ids;
+	for(unsigned int x=0;x<chunks.size();++x) {
+		for(unsigned int y=0;y<chunks[x].size();++y) {
+			if(chunks[x][y].IDs)
+				continue;
+			generated_chunks.push_back(&chunks[x][y]);
+			generated_seeds.push_back(rd());
+		}
+	}
+	generated_ids.resize(generated_chunks.size());
+
+	JobSystem::global().parallel_for(0, generated_chunks.size(), 1, [&](size_t i) {
+		chunk &c = *generated_chunks[i];
+		std::default_random_engine chunk_engine(generated_seeds[i]);
+		std::uniform_int_distribution<int> chunk_dist(dist.param());
+		VoxelBuffer ids(chunk_total);
+		for(int _z=0;_z<chunk_size.z;++_z) {
+			for(int _y=0;_y<chunk_size.y;++_y) {
+				for(int _x=0;_x<chunk_size.x;++_x) {
+					int height = abs(_x-(chunk_size.x/2)) 
+					           + abs(_y-(chunk_size.y/2));
+					size_t index = _z*chunk_size.x*chunk_size.y
+					             + _y*chunk_size.x
+					             + _x;
+					ids[index] =
+						(_z>height)?chunk_dist(chunk_engine):0;
 				}
 			}
+		}
+		generated_ids[i].assign(ids.data());
+		c.IDs = &generated_ids[i];
+	});
 
-			glActiveTexture(chunks[x][y].texnum);
-			glGenTextures(1, &chunks[x][y].texid);
-			glBindTexture(GL_TEXTURE_3D, chunks[x][y].texid);
-			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, 0);
-			glTexParameterfv(GL_TEXTURE_3D, GL_TEXTURE_BORDER_COLOR, col);
-			glTexImage3D(
-				GL_TEXTURE_3D, 0, GL_R8UI, chunk_size.x, chunk_size.y, 
-				chunk_size.z, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, 
-				chunks[x][y].IDs->data()
-			);
+	for(auto c : generated_chunks) {
+		upload_chunk_ids(c->position.x, c->position.y);
+	}
+
+	for(auto &cv : chunks) {
+		for(auto &c : cv) {
+			for(int s=0;s<Mesher::sections;++s) {
+				int min[3], max[3];
+				if(c.IDs->section_bounds(s, min, max)) {
+					c.bounds_min[s] = glm::vec3(min[0], min[1], min[2]);
+					c.bounds_max[s] = glm::vec3(max[0], max[1], max[2]) + glm::vec3(1.f);
+				}
+				else {
+					c.bounds_min[s] = glm::vec3(1.f);
+					c.bounds_max[s] = glm::vec3(0.f);
+				}
+			}
 		}
 	}
+
+	{
+		std::string report = SlabAllocator::report();
+		wlog.log(L"Voxel pools:\n" + std::wstring(report.begin(), report.end()));
+		report = SectionStore::global().report();
+		wlog.log(std::wstring(report.begin(), report.end()));
+	}
 	process_gl_errors();
 
 	glUseProgram(render_program);
 
 	glViewport(0.f, 0.f, win_size_x, win_size_y);
 
-	wlog.log(L"Creating and getting transform uniform data.\n");
-	GLint model_uni = glGetUniformLocation(render_program, "model");
+	wlog.log(L"Creating chunk origin buffer.\n");
+	std::vector<glm::vec4> origins(num_chunks.x*num_chunks.y);
+	for(int x=0;x<num_chunks.x;++x) {
+		for(int y=0;y<num_chunks.y;++y) {
+			origins[x*num_chunks.y + y] = glm::vec4(
+				glm::vec3(chunk_size.x, chunk_size.y, chunk_size.z)*
+					glm::vec3(chunks[x][y].position), 1.f
+			);
+		}
+	}
+	GLuint chunk_origins_buffer;
+	glGenBuffers(1, &chunk_origins_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, chunk_origins_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec4)*origins.size(), origins.data(), GL_STATIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, chunk_origins_buffer);
 
 	process_gl_errors();
 
@@ -527,26 +691,30 @@ int main()
 	GLint light_rad_uni = glGetUniformLocation(lighting_program, "sample_radius");
 	GLint light_scale_uni = glGetUniformLocation(lighting_program, "scale");
 
-	glUseProgram(frustum_culling_program);
-
-	GLint frustum_view_uni = glGetUniformLocation(frustum_culling_program, "view");
-	GLint frustum_proj_uni = glGetUniformLocation(frustum_culling_program, "proj");
-	glUniformMatrix4fv(frustum_proj_uni, 1, GL_FALSE, glm::value_ptr(projection));
-	GLint frustum_chunk_size_uni = glGetUniformLocation(frustum_culling_program, "chunkSize");
-	glUniform3fv(frustum_chunk_size_uni, 1, glm::value_ptr(
+	glUseProgram(cull_program);
+
+	GLint cull_view_uni = glGetUniformLocation(cull_program, "view");
+	GLint cull_eye_uni = glGetUniformLocation(cull_program, "eye");
+	GLint cull_page_draws_uni = glGetUniformLocation(cull_program, "pageDraws");
+	GLint cull_phase_uni = glGetUniformLocation(cull_program, "phase");
+	GLint cull_hiz_transform_uni = glGetUniformLocation(cull_program, "hizTransform");
+	GLint cull_occlusion_uni = glGetUniformLocation(cull_program, "occlusion");
+	glUniform1i(glGetUniformLocation(cull_program, "hiz"), 8);
+	glUniformMatrix4fv(glGetUniformLocation(cull_program, "proj"), 1, GL_FALSE, glm::value_ptr(projection));
+	glUniform3fv(glGetUniformLocation(cull_program, "chunkSize"), 1, glm::value_ptr(
 		glm::vec3(chunk_size.x,chunk_size.y,chunk_size.z))
 	);
+	glUniform2i(glGetUniformLocation(cull_program, "worldChunks"), num_chunks.x, num_chunks.y);
 
 	glUseProgram(generate_program);
 
 	wlog.log(L"Setting up transform feedback.\n");
 
-	wlog.log(L"Creating and setting block chunk texture uniform data.\n");
-	GLint chunk_id_uni = glGetUniformLocation(generate_program, "IDTex");
-	glUniform1i(chunk_id_uni, 1);
-
-	wlog.log(L"Creating and setting block chunk neighbors uniform data.\n");
-	GLint neighbor_id_uni = glGetUniformLocation(generate_program, "neighbors");
+	wlog.log(L"Creating and setting world ID texture uniform data.\n");
+	glUniform1i(glGetUniformLocation(generate_program, "worldIDs"), 1);
+	glUniform2i(glGetUniformLocation(generate_program, "worldChunks"), num_chunks.x, num_chunks.y);
+	glUniform1i(glGetUniformLocation(generate_program, "worldSlotsX"), world_slots_x);
+	GLint chunk_position_uni = glGetUniformLocation(generate_program, "chunkPosition");
 
 	wlog.log(L"Creating and setting block chunk is bottom uniform data.\n");
 	GLint chunk_is_bottom_id_uni = glGetUniformLocation(generate_program, "chunkIsBottom");
@@ -575,211 +743,480 @@ int main()
 	auto start_tf = std::chrono::high_resolution_clock::now();
 
 
-	std::vector<GLboolean> ssbo_null(chunk_total*24, GL_FALSE);
-	GLuint ssbo;
-	glGenBuffers(1, &ssbo);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, chunk_total*24*sizeof(GLboolean), ssbo_null.data(), GL_STREAM_COPY);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssbo);
-
-	GLuint tbo;
-	GLuint tfo;
-	glGenTransformFeedbacks(1, &tfo);
-	glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, tfo);
-	glGenBuffers(1, &tbo);
-	glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, tbo);
-	glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, sizeof(float)*chunk_total*12*3*components_per_vtx, nullptr, GL_STREAM_COPY);
+	const size_t chunk_count = num_chunks.x*num_chunks.y;
+
+	// Chunks found in the mesh cache aren't meshed by any mesher, their
+	//  quads are uploaded straight from the mapped file. Keys are hashes of
+	//  the padded chunks, computed on the job system. Meshes of the misses
+	//  are added to the cache, which is saved once all chunks are done. The
+	//  cache only holds meshes of the selected mesher, with the shaders it
+	//  was built with.
+	MeshCache mesh_cache;
+	bool use_mesh_cache = mesh_cache_file != "none";
+	std::vector<MeshCache::Key> cache_keys(chunk_count);
+	std::vector<MeshCache::Entry> cached_meshes(chunk_count);
+	std::vector<char> cache_hits(chunk_count, false);
+	if(use_mesh_cache) {
+		std::vector<const char*> mesher_files;
+		if(compute_mesher)
+			mesher_files = {"assets/shaders/generate/shader.comp"};
+		else if(!cpu_mesher)
+			mesher_files = {"assets/shaders/generate/shader.vert", "assets/shaders/generate/shader.geom"};
+		std::vector<std::string> mesher_sources(mesher_files.size());
+		for(size_t i=0;i<mesher_files.size();++i)
+			readfile(mesher_files[i], mesher_sources[i]);
+		uint64_t mesher_id = MeshCache::mesher_id(
+			cpu_mesher ? "cpu" : compute_mesher ? "compute" : "gpu", mesher_sources
+		);
+		if(!mesh_cache.open(mesh_cache_file, mesher_id))
+			wlog.log(L"No usable mesh cache, meshing every chunk.\n");
+		JobSystem::global().parallel_for(0, chunk_count, 1, [&](size_t i) {
+			static thread_local PaddedChunk padded;
+			padded.fill(i/num_chunks.y, i%num_chunks.y, neighbour_ids);
+			// Always the bottom chunk, see chunkIsBottom below
+			cache_keys[i] = MeshCache::key(padded, true);
+		});
+		for(size_t i=0;i<chunk_count;++i)
+			cache_hits[i] = mesh_cache.find(cache_keys[i], cached_meshes[i]);
+	}
 
-	uint64_t chunk_total_primitives = 0;
-	uint64_t chunk_total_vertices = 0;
-	uint64_t chunk_total_components = 0;
+	// The CPU mesher meshes every chunk up front on the job system, the
+	//  loop below only uploads the results.
+	std::vector<std::vector<Mesher::Quad>> cpu_meshes;
+	std::vector<Mesher::Stats> cpu_stats;
+	if(cpu_mesher) {
+		cpu_meshes.resize(chunk_count);
+		cpu_stats.resize(cpu_meshes.size());
+		JobSystem::global().parallel_for(0, cpu_meshes.size(), 1, [&](size_t i) {
+			if(cache_hits[i])
+				return;
+			static thread_local PaddedChunk padded;
+			padded.fill(i/num_chunks.y, i%num_chunks.y, neighbour_ids);
+			cpu_stats[i] = Mesher::mesh(padded, cpu_meshes[i], true);
+		});
+	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	// The compute shader meshes in two passes over all chunks. The first
+	//  only counts each chunk's quads, then every chunk gets an allocation
+	//  of exactly that size in the geometry heap below and the second pass
+	//  writes it straight into its place there.
+	//  generate_chunk_list holds the chunks to mesh, generate_quad_counts
+	//  a counter per direction and section of each chunk and
+	//  generate_quad_ranges the first quad and quad count of each of them in
+	//  their heap page.
+	GLuint generate_chunk_list = 0;
+	GLuint generate_quad_counts = 0;
+	GLuint generate_quad_ranges = 0;
+	std::vector<GLuint> compute_quads;
+	// Chunks in generate_chunk_list, the ones the cache didn't have
+	GLuint compute_chunks = 0;
+	if(compute_mesher) {
+		size_t range_count = chunk_count*Mesher::directions*Mesher::sections;
+		std::vector<GLuint> chunk_list;
+		for(size_t i=0;i<chunk_count;++i) {
+			if(!cache_hits[i])
+				chunk_list.push_back(i);
+		}
+		compute_chunks = chunk_list.size();
+		glGenBuffers(1, &generate_chunk_list);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, generate_chunk_list);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint)*chunk_list.size(), chunk_list.data(), GL_STATIC_DRAW);
+		glGenBuffers(1, &generate_quad_ranges);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, generate_quad_ranges);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, 2*sizeof(GLuint)*range_count, nullptr, GL_STATIC_DRAW);
+
+		GLuint zero = 0;
+		glGenBuffers(1, &generate_quad_counts);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, generate_quad_counts);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint)*range_count, nullptr, GL_DYNAMIC_READ);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, generate_quad_counts);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, generate_chunk_list);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, generate_quad_ranges);
+
+		glUseProgram(generate_compute_program);
+		glUniform1i(glGetUniformLocation(generate_compute_program, "worldIDs"), 1);
+		glUniform2i(glGetUniformLocation(generate_compute_program, "worldChunks"), num_chunks.x, num_chunks.y);
+		glUniform1i(glGetUniformLocation(generate_compute_program, "worldSlotsX"), world_slots_x);
+		glUniform1i(glGetUniformLocation(generate_compute_program, "chunkIsBottom"), true);
+		glUniform1i(glGetUniformLocation(generate_compute_program, "countOnly"), true);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_3D, world_ids);
+		// 256 tiles of 16x16 faces per direction and chunk
+		glDispatchCompute(256, Mesher::directions, compute_chunks);
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+		// The only wait for the GPU, the counters then become the write
+		//  cursors of the second pass
+		compute_quads.resize(range_count);
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint)*range_count, compute_quads.data());
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		glUniform1i(glGetUniformLocation(generate_compute_program, "countOnly"), false);
+		glUseProgram(generate_program);
+	}
 
-	GLuint query;
-	glGenQueries(1, &query);
-	for(unsigned int x=0;x<chunks.size();++x) {
-		for(unsigned int y=0;y<chunks[x].size();++y) {
-			glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, tbo);
-			glEnable(GL_RASTERIZER_DISCARD);
-			glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, tbo);
+	// Buffers of the generate geometry shader, which writes the quads of
+	//  one chunk after the other into tbo, counting each chunk's with its
+	//  own query. The element buffer holds the voxels of a chunk that can
+	//  have a face, each of them emits at most one quad per direction.
+	//  Only when tbo is full, or all chunks are done, are the counts and
+	//  quads read back, a single wait for the GPU per batch of chunks.
+	const GLuint generate_batch_quads = 8*chunk_total*Mesher::directions;
+	GLuint tbo = 0;
+	GLuint tfo = 0;
+	GLuint generate_ebo = 0;
+	struct generate_batch_chunk {
+		int x, y;
+		GLuint first_quad;
+	};
+	std::vector<generate_batch_chunk> generate_batch;
+	std::vector<GLuint> generate_queries;
+	GLuint generate_batch_used = 0;
+	if(!cpu_mesher && !compute_mesher) {
+		glGenBuffers(1, &generate_ebo);
+		glBindVertexArray(generate_vao);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, generate_ebo);
+
+		glGenTransformFeedbacks(1, &tfo);
+		glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, tfo);
+		glGenBuffers(1, &tbo);
+		glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, tbo);
+		glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, quad_bytes*generate_batch_quads, nullptr, GL_STREAM_READ);
+	}
 
-			glBindBuffer(GL_ARRAY_BUFFER, vbo);
-			glBindVertexArray(generate_vao);
+	// Chunk meshes live in the geometry heap: a few large buffers, one per
+	//  page, that every chunk's quads are sub-allocated from, so meshes can
+	//  be replaced and freed one at a time. heap_buffers[p] backs page p.
+	GeometryHeap geometry_heap(heap_page_quads);
+	std::vector<GLuint> heap_buffers;
+	auto heap_allocate = [&](GLuint quads) {
+		GeometryHeap::Handle handle = geometry_heap.allocate(quads);
+		while(heap_buffers.size() < geometry_heap.page_count()) {
+			GLuint buffer;
+			glGenBuffers(1, &buffer);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glBufferData(
+				GL_COPY_WRITE_BUFFER,
+				quad_bytes*geometry_heap.page_capacity(heap_buffers.size()),
+				nullptr, GL_DYNAMIC_DRAW
+			);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			heap_buffers.push_back(buffer);
+		}
+		return handle;
+	};
 
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_3D, empty_chunk.texid);
-			empty_chunk.tex = 0;
+	// Every mesher's chunks get their allocation as soon as their quad
+	//  count is known, and the quads are written straight into it. The
+	//  compute shader writes its own, see below.
+	uint64_t chunk_total_quads = 0;
+	GLuint max_chunk_quads = 0;
+	auto place_mesh = [&](int x, int y, GLuint quads, const Mesher::Quad *data) {
+		chunk &c = chunks[x][y];
+		c.quad_count = quads;
+		c.geometry = heap_allocate(quads);
+		if(data && quads) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, heap_buffers[geometry_heap.page(c.geometry)]);
+			glBufferSubData(
+				GL_COPY_WRITE_BUFFER, quad_bytes*geometry_heap.first(c.geometry),
+				quad_bytes*quads, data
+			);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		chunk_total_quads += quads;
+		max_chunk_quads = std::max(max_chunk_quads, quads);
+		wlog.log(
+			L"Chunk["+std::to_wstring(x)+L"]["+std::to_wstring(y)+L"] buffer size: "
+			+ std::to_wstring(quads*quad_bytes)
+			+ L"; total: "
+			+ std::to_wstring(chunk_total_quads*quad_bytes)
+			+ L"\n"
+		);
+	};
 
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_3D, chunks[x][y].texid);
-			chunks[x][y].tex = 1;
+	// Reads back the quads of the batch of chunks in tbo. Transform
+	//  feedback keeps the order of the candidate voxels, which only follows
+	//  the sections, so the quads are sorted into direction and section
+	//  ranges on the host.
+	std::vector<Mesher::Quad> generate_quads;
+	auto finish_generate_batch = [&]() {
+		if(generate_batch.empty())
+			return;
+		glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, tbo);
+		const Mesher::Quad *written = static_cast<const Mesher::Quad*>(glMapBufferRange(
+			GL_TRANSFORM_FEEDBACK_BUFFER, 0, quad_bytes*generate_batch_used, GL_MAP_READ_BIT
+		));
+		for(size_t i=0;i<generate_batch.size();++i) {
+			const generate_batch_chunk &b = generate_batch[i];
+			// One point is written per quad
+			GLuint quads = 0;
+			glGetQueryObjectuiv(generate_queries[i], GL_QUERY_RESULT, &quads);
+			generate_quads.assign(written + b.first_quad, written + b.first_quad + quads);
+			chunk &c = chunks[b.x][b.y];
+			Mesher::sort(generate_quads, c.range_quads);
+			if(use_mesh_cache)
+				mesh_cache.store(cache_keys[b.x*num_chunks.y + b.y], generate_quads.data(), quads, c.range_quads);
+			place_mesh(b.x, b.y, quads, generate_quads.data());
+		}
+		glUnmapBuffer(GL_TRANSFORM_FEEDBACK_BUFFER);
+		glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+		generate_batch.clear();
+		generate_batch_used = 0;
+	};
 
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-			// Get neighboring chunks, or set to empty_chunk if none
-			GLint neighbor_tex[6];
-			neighbor_tex[0]=0;
-			glActiveTexture(GL_TEXTURE2);
-			if(x) {
-				glBindTexture(GL_TEXTURE_3D, chunks[x-1][y].texid);
-				neighbor_tex[1]=2;
-			}
-			else {
-				neighbor_tex[1]=0;
-			}
-			glActiveTexture(GL_TEXTURE3);
-			if(y) {
-				glBindTexture(GL_TEXTURE_3D, chunks[x][y-1].texid);
-				neighbor_tex[2]=3;
-			}
-			else {
-				neighbor_tex[2]=0;
-			}
-			glActiveTexture(GL_TEXTURE4);
-			if(x<num_chunks.x-1) {
-				glBindTexture(GL_TEXTURE_3D, chunks[x+1][y].texid);
-				neighbor_tex[3]=4;
+	std::vector<uint32_t> generate_voxels;
+	for(unsigned int x=0;x<chunks.size();++x) {
+		for(unsigned int y=0;y<chunks[x].size();++y) {
+			GLuint quads = 0;
+			GLuint *range_quads = &chunks[x][y].range_quads[0][0];
+			const size_t ranges = Mesher::directions*Mesher::sections;
+			size_t index = x*num_chunks.y + y;
+			if(cache_hits[index]) {
+				const MeshCache::Entry &cached = cached_meshes[index];
+				quads = cached.quad_count;
+				std::copy(&cached.range_quads[0][0], &cached.range_quads[0][0]+ranges, range_quads);
+				// Placed among the computed chunks, see below
+				if(compute_mesher)
+					std::copy(range_quads, range_quads+ranges, &compute_quads[index*ranges]);
+				place_mesh(x, y, quads, cached.quads);
 			}
-			else {
-				neighbor_tex[3]=0;
+			else if(compute_mesher) {
+				// Written straight into the geometry heap below
+				for(size_t r=0;r<ranges;++r) {
+					range_quads[r] = compute_quads[index*ranges + r];
+					quads += range_quads[r];
+				}
+				place_mesh(x, y, quads, nullptr);
 			}
-			glActiveTexture(GL_TEXTURE5);
-			if(y<num_chunks.y-1) {
-				glBindTexture(GL_TEXTURE_3D, chunks[x][y+1].texid);
-				neighbor_tex[4]=5;
+			else if(cpu_mesher) {
+				const std::vector<Mesher::Quad> &mesh = cpu_meshes[index];
+				quads = mesh.size();
+				const Mesher::Stats &stats = cpu_stats[index];
+				std::copy(&stats.range_quads[0][0], &stats.range_quads[0][0]+ranges, range_quads);
+				if(use_mesh_cache)
+					mesh_cache.store(cache_keys[index], mesh.data(), quads, stats.range_quads);
+				place_mesh(x, y, quads, mesh.data());
 			}
 			else {
-				neighbor_tex[4]=0;
-			}
-			neighbor_tex[5]=0;
-
-			glUniform1i(chunk_id_uni, chunks[x][y].tex);
-			//This is always true for now, as we only have a world height
-			//  of 1 chunk
-			glUniform1i(chunk_is_bottom_id_uni, true);
-			glUniform1iv(neighbor_id_uni, 6, neighbor_tex);
-
-			glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
-			glBufferData(GL_SHADER_STORAGE_BUFFER, chunk_total*24*sizeof(GLboolean), ssbo_null.data(), GL_STREAM_COPY);
-			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, ssbo);
-
-			glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, query);
-			glBeginTransformFeedback(GL_TRIANGLES);
-				for(int i = 0; i < chunk_total; ++i) {
-					glDrawArrays(GL_POINTS, i, 1);
-					glFinish();
+				// Air, empty sections and the inside of full sections never
+				//  produce a face
+				chunks[x][y].IDs->candidate_voxels(generate_voxels);
+				GLuint most_quads = generate_voxels.size()*Mesher::directions;
+				if(generate_batch_used + most_quads > generate_batch_quads)
+					finish_generate_batch();
+				if(generate_queries.size() == generate_batch.size()) {
+					GLuint query;
+					glGenQueries(1, &query);
+					generate_queries.push_back(query);
 				}
-			glEndTransformFeedback();
-			glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
-
-			glDisable(GL_RASTERIZER_DISCARD);
-
-			GLuint primitives;
-			glGetQueryObjectuiv(query, GL_QUERY_RESULT, &primitives);
-
-			glGenBuffers(1, &chunks[x][y].buffer_geometry);
-			glBindBuffer(GL_COPY_WRITE_BUFFER, chunks[x][y].buffer_geometry);
-			glBufferData(GL_COPY_WRITE_BUFFER, sizeof(float)*primitives*3*components_per_vtx, nullptr, GL_STATIC_COPY);
-			glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
-			glBindBuffer(GL_COPY_READ_BUFFER , tbo);
-			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(float)*primitives*3*components_per_vtx);
-			glBindBuffer(GL_COPY_READ_BUFFER , 0);
-			glBindBuffer(GL_COPY_WRITE_BUFFER , 0);
-			chunks[x][y].primitive_count = primitives;
-			chunks[x][y].vertex_count = primitives*3;
-			chunks[x][y].component_count = chunks[x][y].vertex_count*components_per_vtx;
-			chunk_total_primitives += chunks[x][y].primitive_count;
-			chunk_total_vertices += chunks[x][y].vertex_count;
-			chunk_total_components += chunks[x][y].component_count;
-			wlog.log(
-				L"Chunk["+std::to_wstring(x)+L"]["+std::to_wstring(y)+L"] buffer size: "
-				+ std::to_wstring(chunks[x][y].component_count*sizeof(float))
-				+ L"; total: "
-				+ std::to_wstring(chunk_total_components*sizeof(float))
-				+ L"\n"
-			);
-			glBindBuffer(GL_ARRAY_BUFFER, chunks[x][y].buffer_geometry);
-			glGenVertexArrays(1, &chunks[x][y].vtx_array);
-			glBindVertexArray(chunks[x][y].vtx_array);
-			GLint pos_attrib = glGetAttribLocation(render_program, "pos");
-			if(pos_attrib != -1) {
-				glEnableVertexAttribArray(pos_attrib);
-				glVertexAttribPointer(pos_attrib, 3, GL_FLOAT, GL_FALSE, components_per_vtx*sizeof(GLfloat), BUFFER_OFFSET(sizeof(float)*0));
-			}
-
-			GLint texcoord_attrib = glGetAttribLocation(render_program, "texcoords");
-			if(texcoord_attrib != -1) {
-				glEnableVertexAttribArray(texcoord_attrib);
-				glVertexAttribPointer(texcoord_attrib, 3, GL_FLOAT, GL_FALSE, components_per_vtx*sizeof(GLfloat), BUFFER_OFFSET(sizeof(float)*3));
-			}
-
-			GLint normal_attrib = glGetAttribLocation(render_program, "normal");
-			if(normal_attrib != -1) {
-				glEnableVertexAttribArray(normal_attrib);
-				glVertexAttribPointer(normal_attrib, 3, GL_FLOAT, GL_FALSE, components_per_vtx*sizeof(GLfloat), BUFFER_OFFSET(sizeof(float)*6));
+				GLuint query = generate_queries[generate_batch.size()];
+				generate_batch.push_back(generate_batch_chunk{int(x), int(y), generate_batch_used});
+
+				glEnable(GL_RASTERIZER_DISCARD);
+				glBindBufferRange(
+					GL_TRANSFORM_FEEDBACK_BUFFER, 0, tbo,
+					quad_bytes*generate_batch_used, quad_bytes*std::max<GLuint>(most_quads, 1)
+				);
+				generate_batch_used += most_quads;
+
+				glBindBuffer(GL_ARRAY_BUFFER, vbo);
+				glBindVertexArray(generate_vao);
+
+				// Blocks of this chunk and its neighbours all come from the
+				//  world ID texture
+				glActiveTexture(GL_TEXTURE1);
+				glBindTexture(GL_TEXTURE_3D, world_ids);
+				glUniform2i(chunk_position_uni, x, y);
+				//This is always true for now, as we only have a world height
+				//  of 1 chunk
+				glUniform1i(chunk_is_bottom_id_uni, true);
+
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, generate_voxels.size()*sizeof(uint32_t), generate_voxels.data(), GL_STREAM_DRAW);
+
+				// Each voxel decides on its own which merged faces it emits,
+				//  so the whole chunk goes through in one draw
+				glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, query);
+				glBeginTransformFeedback(GL_POINTS);
+					glDrawElements(GL_POINTS, generate_voxels.size(), GL_UNSIGNED_INT, 0);
+				glEndTransformFeedback();
+				glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+
+				glDisable(GL_RASTERIZER_DISCARD);
 			}
 		}
 	}
+	finish_generate_batch();
+	if(!generate_queries.empty())
+		glDeleteQueries(generate_queries.size(), generate_queries.data());
 
 	glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
 	glDeleteTransformFeedbacks(1, &tfo);
 	glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
 	glDeleteBuffers(1, &tbo);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-	glDeleteBuffers(1, &ssbo);
 	glDeleteVertexArrays(1, &generate_vao);
 	glBindVertexArray(0);
-	ssbo_null.clear();
-
-	std::vector<std::vector<chunk_group>> chunk_groupings(
-		num_chunks.x/chunk_grouping.x, std::vector<chunk_group>{num_chunks.y/chunk_grouping.y}
-	);
-
-	for(int x = 0; x < num_chunks.x/chunk_grouping.x; ++x) {
-		for(int y = 0; y < num_chunks.y/chunk_grouping.y; ++y) {
-			size_t sum = 0;
-			for(int i = 0; i < chunk_grouping.x; ++i) {
-				for(int j = 0; j < chunk_grouping.y; ++j) {
-					chunk_groupings[x][y].chunks.push_back(&chunks[x*chunk_grouping.x+i][y*chunk_grouping.y+j]);
-					sum += chunks[x*chunk_grouping.x+i][y*chunk_grouping.y+j].component_count * sizeof(float);
-				}
+	glDeleteBuffers(1, &generate_ebo);
+
+
+	// Second pass of the compute shader, see generate_chunk_list. Each
+	//  chunk's ranges start at its allocation, and the chunks are meshed one
+	//  heap page at a time with that page's buffer bound.
+	if(compute_mesher) {
+		const size_t ranges = Mesher::directions*Mesher::sections;
+		std::vector<GLuint> quad_ranges(2*compute_quads.size());
+		std::vector<std::vector<GLuint>> page_chunks(geometry_heap.page_count());
+		for(size_t i=0;i<chunk_count;++i) {
+			const chunk &c = chunks[i/num_chunks.y][i%num_chunks.y];
+			GLuint first = geometry_heap.first(c.geometry);
+			for(size_t r=0;r<ranges;++r) {
+				size_t index = i*ranges + r;
+				quad_ranges[2*index+0] = first;
+				quad_ranges[2*index+1] = compute_quads[index];
+				first += compute_quads[index];
 			}
-			glGenBuffers(1, &chunk_groupings[x][y].merged_geometry);
-			glBindBuffer(GL_COPY_WRITE_BUFFER, chunk_groupings[x][y].merged_geometry);
-			glBufferData(GL_COPY_WRITE_BUFFER, sum, nullptr, GL_STATIC_COPY);
-			sum = 0;
-			for(auto &c : chunk_groupings[x][y].chunks) {
-				glBindBuffer(GL_COPY_READ_BUFFER , c->buffer_geometry);
-				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, sum, c->component_count*sizeof(float));
-				glBindBuffer(GL_COPY_READ_BUFFER, 0);
-				glDeleteBuffers(1, &c->buffer_geometry);
-				sum += c->component_count*sizeof(float);
+			if(c.quad_count && !cache_hits[i])
+				page_chunks[geometry_heap.page(c.geometry)].push_back(i);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, generate_quad_ranges);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint)*quad_ranges.size(), quad_ranges.data());
+
+		glUseProgram(generate_compute_program);
+		for(size_t p=0;p<page_chunks.size();++p) {
+			if(page_chunks[p].empty())
+				continue;
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, generate_chunk_list);
+			glBufferData(
+				GL_SHADER_STORAGE_BUFFER, sizeof(GLuint)*page_chunks[p].size(),
+				page_chunks[p].data(), GL_STATIC_DRAW
+			);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, heap_buffers[p]);
+			glDispatchCompute(256, Mesher::directions, page_chunks[p].size());
+		}
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		glUseProgram(generate_program);
+
+		// Meshes of the misses go into the cache
+		if(use_mesh_cache && compute_chunks) {
+			glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+			std::vector<Mesher::Quad> computed;
+			for(size_t i=0;i<chunk_count;++i) {
+				if(cache_hits[i])
+					continue;
+				const chunk &c = chunks[i/num_chunks.y][i%num_chunks.y];
+				computed.resize(c.quad_count);
+				if(c.quad_count) {
+					glBindBuffer(GL_SHADER_STORAGE_BUFFER, heap_buffers[geometry_heap.page(c.geometry)]);
+					glGetBufferSubData(
+						GL_SHADER_STORAGE_BUFFER, quad_bytes*geometry_heap.first(c.geometry),
+						quad_bytes*c.quad_count, computed.data()
+					);
+				}
+				mesh_cache.store(cache_keys[i], computed.data(), c.quad_count, c.range_quads);
 			}
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-			glBindBuffer(GL_COPY_READ_BUFFER, 0);
-			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
-
-			glBindBuffer(GL_ARRAY_BUFFER, chunk_groupings[x][y].merged_geometry);
-			glGenVertexArrays(1, &chunk_groupings[x][y].vtx_array);
-			glBindVertexArray(chunk_groupings[x][y].vtx_array);
-			GLint pos_attrib = glGetAttribLocation(render_program, "pos");
-			if(pos_attrib != -1) {
-				glEnableVertexAttribArray(pos_attrib);
-				glVertexAttribPointer(pos_attrib, 3, GL_FLOAT, GL_FALSE, components_per_vtx*sizeof(GLfloat), BUFFER_OFFSET(sizeof(float)*0));
-			}
+		for(int binding : {1, 2, 4, 5})
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+		glDeleteBuffers(1, &generate_chunk_list);
+		glDeleteBuffers(1, &generate_quad_counts);
+		glDeleteBuffers(1, &generate_quad_ranges);
+	}
+	{
+		std::string report = geometry_heap.report();
+		wlog.log(std::wstring(report.begin(), report.end()));
+	}
 
-			GLint texcoord_attrib = glGetAttribLocation(render_program, "texcoords");
-			if(texcoord_attrib != -1) {
-				glEnableVertexAttribArray(texcoord_attrib);
-				glVertexAttribPointer(texcoord_attrib, 3, GL_FLOAT, GL_FALSE, components_per_vtx*sizeof(GLfloat), BUFFER_OFFSET(sizeof(float)*3));
-			}
+	// Chunks are drawn from the records in their heap page, which the
+	//  render shader reads by gl_VertexID. The only vertex input is this
+	//  index buffer, shared by all chunks: quad q uses vertices 4q to 4q+3,
+	//  and the draw's base vertex moves it to the chunk's first quad.
+	//  It is rebuilt when an edited chunk outgrows it.
+	std::vector<GLuint> quad_indices;
+	GLuint quad_vao, quad_ebo;
+	glGenVertexArrays(1, &quad_vao);
+	glBindVertexArray(quad_vao);
+	glGenBuffers(1, &quad_ebo);
+	auto upload_quad_indices = [&](GLuint quads) {
+		quad_indices.resize(indices_per_quad*quads);
+		for(GLuint q=0;q<quads;++q) {
+			const GLuint corners[indices_per_quad] = {0, 1, 2, 2, 1, 3};
+			for(int i=0;i<indices_per_quad;++i)
+				quad_indices[q*indices_per_quad + i] = 4*q + corners[i];
+		}
+		glBindVertexArray(quad_vao);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad_ebo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint)*quad_indices.size(), quad_indices.data(), GL_STATIC_DRAW);
+		glBindVertexArray(0);
+	};
+	upload_quad_indices(max_chunk_quads);
+
+	// Sections are culled on the GPU by the cull shader, which writes the
+	//  draw commands of the visible ranges of each heap page and their
+	//  count, so a frame is drawn without waiting for the GPU.
+	//  cull_chunks_buffer holds where each chunk's quads are,
+	//  cull_bounds_buffer the box around each section's solid blocks, as the
+	//  lowest corner, then the highest.
+	//  A chunk has at most one command per direction for every other
+	//  section, so page p's commands in draw_commands_buffer start at
+	//  p*page_draws and draw_counts_buffer holds one count per page. Both
+	//  grow with the heap.
+	const size_t chunk_draws = Mesher::directions*Mesher::sections/2;
+	const GLuint page_draws = chunk_draws*chunk_count;
+	GLuint cull_chunks_buffer, cull_bounds_buffer;
+	GLuint draw_commands_buffer, draw_counts_buffer;
+	glGenBuffers(1, &cull_chunks_buffer);
+	glGenBuffers(1, &cull_bounds_buffer);
+	glGenBuffers(1, &draw_commands_buffer);
+	glGenBuffers(1, &draw_counts_buffer);
+	uint32_t draw_pages = 0;
+	// The sections the first cull phase found hidden, a mask per chunk, and
+	//  the number of sections drawn and culled, see CullStats in the cull
+	//  shader. The host reads them once per second.
+	GLuint cull_retest_buffer, cull_stats_buffer;
+	glGenBuffers(1, &cull_retest_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cull_retest_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint)*chunk_count, nullptr, GL_DYNAMIC_COPY);
+	glGenBuffers(1, &cull_stats_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cull_stats_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint)*3, nullptr, GL_DYNAMIC_READ);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-			GLint normal_attrib = glGetAttribLocation(render_program, "normal");
-			if(normal_attrib != -1) {
-				glEnableVertexAttribArray(normal_attrib);
-				glVertexAttribPointer(normal_attrib, 3, GL_FLOAT, GL_FALSE, components_per_vtx*sizeof(GLfloat), BUFFER_OFFSET(sizeof(float)*6));
-			}
+	// Keeps the cull shader's copy of chunk (x, y) up to date with its
+	//  allocation and its section bounds
+	auto upload_cull_chunk = [&](int x, int y) {
+		const chunk &c = chunks[x][y];
+		size_t index = x*num_chunks.y + y;
+		cull_chunk record{};
+		record.quad_count = c.quad_count;
+		if(c.quad_count) {
+			record.page = geometry_heap.page(c.geometry);
+			record.first_quad = geometry_heap.first(c.geometry);
+		}
+		std::memcpy(record.range_quads, c.range_quads, sizeof(record.range_quads));
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, cull_chunks_buffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(cull_chunk)*index, sizeof(cull_chunk), &record);
+
+		glm::vec3 bounds[2*Mesher::sections];
+		for(int s=0;s<Mesher::sections;++s) {
+			bounds[2*s+0] = c.bounds_min[s];
+			bounds[2*s+1] = c.bounds_max[s];
 		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, cull_bounds_buffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(bounds)*index, sizeof(bounds), bounds);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	};
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cull_chunks_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(cull_chunk)*chunk_count, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cull_bounds_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec3)*2*Mesher::sections*chunk_count, nullptr, GL_DYNAMIC_DRAW);
+	for(int x=0;x<num_chunks.x;++x) {
+		for(int y=0;y<num_chunks.y;++y)
+			upload_cull_chunk(x, y);
 	}
 
 	auto end_tf = std::chrono::high_resolution_clock::now();
@@ -789,21 +1226,21 @@ int main()
 	wlog.log(L"Done generating chunk buffers.\n");
 	wlog.log(L"Generated "+ std::to_wstring(chunks.size()*chunks[0].size())+L" chunks in "+std::to_wstring(time_elapsed.count())+L"µs.\n");
 	wlog.log(
-		L"Chunk buffers total: {primitives: "
-		+ std::to_wstring(chunk_total_primitives)
-		+ L", vertices: "
-		+ std::to_wstring(chunk_total_vertices)
-		+ L", components: "
-		+ std::to_wstring(chunk_total_components)
+		L"Chunk buffers total: {quads: "
+		+ std::to_wstring(chunk_total_quads)
+		+ L", triangles: "
+		+ std::to_wstring(chunk_total_quads*2)
 		+ L", bytes: "
-		+ std::to_wstring(chunk_total_components*sizeof(float))
+		+ std::to_wstring(chunk_total_quads*quad_bytes)
 		+ L"}.\n"
 	);
 
-	for(auto cx : chunks) {
-		for(auto cy : cx) {
-			glDeleteTextures(1, &cy.texid);
-		}
+	if(use_mesh_cache) {
+		std::string report = mesh_cache.report();
+		wlog.log(std::wstring(report.begin(), report.end()));
+		if(mesh_cache.modified() && !mesh_cache.save(mesh_cache_file))
+			wlog.log(L"Couldn't save the mesh cache.\n");
+		mesh_cache.close();
 	}
 
 	wlog.log(L"Starting main loop.\n");
@@ -896,43 +1333,182 @@ int main()
 		glVertexAttribPointer(fb_vao_texcoord_attrib, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float), BUFFER_OFFSET(sizeof(float)*2));
 	}
 
-	GLuint fc_tbo;
-	GLuint fc_tfo;
-	glGenTransformFeedbacks(1, &fc_tfo);
-	glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, fc_tfo);
-	glGenBuffers(1, &fc_tbo);
-	glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, fc_tbo);
-	glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, sizeof(float)*num_chunks.x*num_chunks.y*3, nullptr, GL_STREAM_COPY);
-
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-	GLuint fc_vbo;
-	glGenBuffers(1, &fc_vbo);
-	GLuint fc_vao;
-	glGenVertexArrays(1, &fc_vao);
-	GLuint fc_query;
-	glGenQueries(1, &fc_query);
-	GLuint fc_primitives;
-
-	glBindBuffer(GL_ARRAY_BUFFER, fc_vbo);
-	glBindVertexArray(fc_vao);
-
-	std::vector<glm::ivec3> indices(num_chunks.x*num_chunks.y);
-	for(int y=0;y<num_chunks.y;++y) {
-		for(int x=0;x<num_chunks.x;++x) {
-			indices[x+y*num_chunks.x] = glm::ivec3(x, y, 0);
+	// Pyramid of the farthest depth in each block of pixels, for occlusion
+	//  culling, see the hiz shader. Level 0 is half the render size, the
+	//  last level a single texel. hiz_transform is the projection and view
+	//  of the depth it was last built from.
+	glm::ivec2 hiz_size(render_size.x/2, render_size.y/2);
+	GLsizei hiz_levels = 1;
+	while(std::max(hiz_size.x, hiz_size.y) >> hiz_levels)
+		++hiz_levels;
+	GLuint hiz_texture;
+	glGenTextures(1, &hiz_texture);
+	glActiveTexture(GL_TEXTURE0+8);
+	glBindTexture(GL_TEXTURE_2D, hiz_texture);
+	glTexStorage2D(GL_TEXTURE_2D, hiz_levels, GL_R32F, hiz_size.x, hiz_size.y);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	GLint hiz_source_uni = glGetUniformLocation(hiz_program, "source");
+	GLint hiz_source_level_uni = glGetUniformLocation(hiz_program, "sourceLevel");
+	glProgramUniform1i(hiz_program, hiz_source_uni, 8);
+	glm::mat4 hiz_transform;
+	bool hiz_built = false;
+
+	// Builds the pyramid from the depth drawn so far, level by level
+	auto build_hiz = [&]() {
+		glUseProgram(hiz_program);
+		glActiveTexture(GL_TEXTURE0+8);
+		for(GLsizei level=0;level<hiz_levels;++level) {
+			glBindTexture(GL_TEXTURE_2D, level == 0 ? framebuffer_render_depth_texture : hiz_texture);
+			glUniform1i(hiz_source_level_uni, level == 0 ? 0 : level-1);
+			glBindImageTexture(0, hiz_texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+			glm::ivec2 size(std::max(hiz_size.x >> level, 1), std::max(hiz_size.y >> level, 1));
+			glDispatchCompute((size.x+7)/8, (size.y+7)/8, 1);
+			glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
 		}
-	}
+		glBindTexture(GL_TEXTURE_2D, hiz_texture);
+		hiz_transform = projection*view;
+		hiz_built = true;
+	};
 
-	std::vector<glm::ivec3> visible_indices(num_chunks.x*num_chunks.y);
+	// Block edits. The box of voxels that changed in a chunk is uploaded to
+	//  its slot of the world ID texture right away, so the generate shaders
+	//  would see the edit too. Dirty sections are remeshed with the CPU
+	//  mesher whichever mesher built them, for at most remesh_budget per
+	//  frame; the rest waits for the next one. A chunk's first edit meshes
+	//  all of it, to get a copy of its quads on the host, which takes a
+	//  whole frame's budget: it is only done first in a frame and nothing
+	//  follows it. Remeshed chunks get a new allocation in the geometry
+	//  heap, and a page that ends up fragmented is compacted into a new
+	//  buffer.
+	EditTracker edits(num_chunks.x, num_chunks.y, [&](int x, int y) {
+		return chunks[x][y].IDs;
+	});
+	const std::chrono::microseconds remesh_budget(2000);
+	PaddedChunk edit_padded;
+	std::vector<GeometryHeap::Move> heap_moves;
+	auto flush_edits = [&]() {
+		int cx, cy, min[3], max[3];
+		while(edits.next_upload(cx, cy, min, max)) {
+			const chunk &c = chunks[cx][cy];
+			int size[3] = {max[0]-min[0]+1, max[1]-min[1]+1, max[2]-min[2]+1};
+			uint8_t *voxels = upload_buffer.data();
+			for(int z=min[2];z<=max[2];++z) {
+				for(int y=min[1];y<=max[1];++y) {
+					for(int x=min[0];x<=max[0];++x)
+						*voxels++ = c.IDs->get(x, y, z);
+				}
+			}
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_3D, world_ids);
+			glTexSubImage3D(
+				GL_TEXTURE_3D, 0, (c.slot%world_slots_x)*chunk_size.x + min[0],
+				(c.slot/world_slots_x)*chunk_size.y + min[1], min[2],
+				size[0], size[1], size[2], GL_RED_INTEGER, GL_UNSIGNED_BYTE,
+				upload_buffer.data()
+			);
+		}
 
-	glBufferData(GL_ARRAY_BUFFER, sizeof(int)*3*num_chunks.x*num_chunks.y, indices.data(), GL_STATIC_DRAW);
+		auto start = std::chrono::high_resolution_clock::now();
+		uint16_t sections;
+		bool remeshed = false;
+		while(
+			std::chrono::high_resolution_clock::now()-start < remesh_budget
+			&& edits.next_remesh(cx, cy, sections)
+		) {
+			chunk &c = chunks[cx][cy];
+			bool full = !c.edited;
+			if(full && remeshed) {
+				edits.defer_remesh(cx, cy, sections);
+				break;
+			}
+			if(full) {
+				sections = 0xffff;
+				c.edited = true;
+			}
+			edit_padded.fill(cx, cy, neighbour_ids);
+			Mesher::remesh(edit_padded, sections, c.quads, c.range_quads);
+			c.quad_count = c.quads.size();
+			geometry_heap.free(c.geometry);
+			c.geometry = GeometryHeap::none;
+			c.geometry = heap_allocate(c.quad_count);
+			if(c.quad_count) {
+				glBindBuffer(GL_COPY_WRITE_BUFFER, heap_buffers[geometry_heap.page(c.geometry)]);
+				glBufferSubData(
+					GL_COPY_WRITE_BUFFER, quad_bytes*geometry_heap.first(c.geometry),
+					quad_bytes*c.quad_count, c.quads.data()
+				);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			}
+			remeshed = true;
+			if(c.quad_count > max_chunk_quads) {
+				max_chunk_quads = c.quad_count;
+				upload_quad_indices(max_chunk_quads);
+			}
 
-	GLint fc_pos_attrib = glGetAttribLocation(frustum_culling_program, "pos");
-	if(fc_pos_attrib != -1) {
-		glEnableVertexAttribArray(fc_pos_attrib);
-		glVertexAttribPointer(fc_pos_attrib, 3, GL_INT, GL_FALSE, 3*sizeof(int), BUFFER_OFFSET(sizeof(float)*0));
-	}
+			for(int s=0;s<Mesher::sections;++s) {
+				if(!(sections >> s & 1))
+					continue;
+				int min[3], max[3];
+				if(c.IDs->section_bounds(s, min, max)) {
+					c.bounds_min[s] = glm::vec3(min[0], min[1], min[2]);
+					c.bounds_max[s] = glm::vec3(max[0], max[1], max[2]) + glm::vec3(1.f);
+				}
+				else {
+					c.bounds_min[s] = glm::vec3(1.f);
+					c.bounds_max[s] = glm::vec3(0.f);
+				}
+			}
+			upload_cull_chunk(cx, cy);
+			if(full)
+				break;
+		}
+		if(!remeshed)
+			return;
+
+		// At most one page per frame. The page's quads are copied into a new
+		//  buffer, so nothing is moved in place, and the page's chunks are
+		//  uploaded to the cull buffers again. Earlier frames still in flight
+		//  keep reading the old buffer and ranges: GL executes commands in
+		//  order, so their draws and cull dispatches were issued before these
+		//  copies and glBufferSubData calls and see the data as it was, and
+		//  the deleted buffer stays alive until they are done. This frame's
+		//  cull runs after all of it, so the draw commands it writes only
+		//  ever point into the new buffer, and no fence is needed.
+		for(uint32_t p=0;p<geometry_heap.page_count();++p) {
+			if(geometry_heap.fragmentation(p) < 0.5f)
+				continue;
+			geometry_heap.defragment(p, heap_moves);
+			GLuint buffer;
+			glGenBuffers(1, &buffer);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glBufferData(GL_COPY_WRITE_BUFFER, quad_bytes*geometry_heap.page_capacity(p), nullptr, GL_DYNAMIC_DRAW);
+			glBindBuffer(GL_COPY_READ_BUFFER, heap_buffers[p]);
+			for(const GeometryHeap::Move &move : heap_moves) {
+				glCopyBufferSubData(
+					GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, quad_bytes*move.from,
+					quad_bytes*move.to, quad_bytes*move.size
+				);
+			}
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			glDeleteBuffers(1, &heap_buffers[p]);
+			heap_buffers[p] = buffer;
+			for(int x=0;x<num_chunks.x;++x) {
+				for(int y=0;y<num_chunks.y;++y) {
+					const chunk &c = chunks[x][y];
+					if(c.quad_count && geometry_heap.page(c.geometry) == p)
+						upload_cull_chunk(x, y);
+				}
+			}
+			std::string report = geometry_heap.report();
+			wlog.log(L"Defragmented heap page " + std::to_wstring(p) + L". "
+				+ std::wstring(report.begin(), report.end()));
+			break;
+		}
+	};
 
 	glUseProgram(render_program);
 
@@ -1012,6 +1588,14 @@ int main()
 				std::to_wstring(1e6L/ft_avg) + L"\t" +
 				L"Frametime avg: "+std::to_wstring(ft_avg)+L"µs\n";
 			wlog.log(frametimestr);
+			GLuint cull_stats[3];
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, cull_stats_buffer);
+			glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(cull_stats), cull_stats);
+			glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+			wlog.log(L"Sections per frame: " + std::to_wstring(cull_stats[2]/cnt)
+				+ L" drawn, " + std::to_wstring(cull_stats[0]/cnt) + L" outside the frustum, "
+				+ std::to_wstring(cull_stats[1]/cnt) + L" occluded\n");
 			cnt=0;
 			ft_total=0.L;
 			wlog.log(L"SSAO Intensity : \t" + std::to_wstring(intensity) + L"\n");
@@ -1090,35 +1674,81 @@ int main()
 			scale -= 0.01;
 			glProgramUniform1f(lighting_program, light_scale_uni, scale);
 		}
+		// Digs out a ball of blocks around the camera
+		if(glfwGetKey(win, GLFW_KEY_X)) {
+			const int radius = 4;
+			glm::ivec3 center = glm::ivec3(glm::floor(-cam.position));
+			EditTracker::Transaction dig;
+			for(int z=-radius;z<=radius;++z) {
+				for(int y=-radius;y<=radius;++y) {
+					for(int x=-radius;x<=radius;++x) {
+						if(x*x + y*y + z*z <= radius*radius)
+							dig.set_block(center.x+x, center.y+y, center.z+z, 0);
+					}
+				}
+			}
+			edits.apply(dig);
+		}
+		flush_edits();
 
-		glUseProgram(frustum_culling_program);
-
-		glUniformMatrix4fv(frustum_view_uni, 1, GL_FALSE, glm::value_ptr(view));
-
-		glBindBuffer(GL_ARRAY_BUFFER, fc_vbo);
-		glBindVertexArray(fc_vao);
-		glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, fc_tfo);
-		glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, fc_tbo);
-		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, fc_tbo);
-
-		glEnable(GL_RASTERIZER_DISCARD);
-
-
-		glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, fc_query);
-		glBeginTransformFeedback(GL_POINTS);
-			glDrawArrays(GL_POINTS, 0, num_chunks.x*num_chunks.y);
-		glEndTransformFeedback();
-		glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
-
-		glDisable(GL_RASTERIZER_DISCARD);
+		view = cam.get_view();
 
-		glGetQueryObjectuiv(fc_query, GL_QUERY_RESULT, &fc_primitives);
+		// Room for the draw commands of pages the heap added since the last
+		//  frame
+		if(draw_pages < geometry_heap.page_count()) {
+			draw_pages = geometry_heap.page_count();
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, draw_commands_buffer);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(draw_command)*page_draws*draw_pages, nullptr, GL_DYNAMIC_COPY);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, draw_counts_buffer);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint)*draw_pages, nullptr, GL_DYNAMIC_COPY);
+		}
 
-		glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, fc_primitives*sizeof(int)*3, visible_indices.data());
+		// Writes the draw commands of the sections phase finds visible, see
+		//  the cull shader
+		auto cull = [&](int phase) {
+			glUseProgram(cull_program);
+			glUniformMatrix4fv(cull_view_uni, 1, GL_FALSE, glm::value_ptr(view));
+			// The camera's position in the world, see camera::get_view
+			glUniform3fv(cull_eye_uni, 1, glm::value_ptr(-cam.position));
+			glUniform1ui(cull_page_draws_uni, page_draws);
+			glUniform1i(cull_phase_uni, phase);
+			glUniform1i(cull_occlusion_uni, occlusion_culling && hiz_built);
+			glUniformMatrix4fv(cull_hiz_transform_uni, 1, GL_FALSE, glm::value_ptr(hiz_transform));
+			glActiveTexture(GL_TEXTURE0+8);
+			glBindTexture(GL_TEXTURE_2D, hiz_texture);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, draw_counts_buffer);
+			glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, cull_stats_buffer);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, cull_chunks_buffer);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cull_bounds_buffer);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, draw_commands_buffer);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, draw_counts_buffer);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, cull_retest_buffer);
+			glDispatchCompute((chunk_count+63)/64, 1, 1);
+			glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+		};
+		// One call per heap page, drawing as many of its commands as the
+		//  cull shader wrote
+		auto draw_world = [&]() {
+			glUseProgram(render_program);
+			glBindVertexArray(quad_vao);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw_commands_buffer);
+			glBindBuffer(GL_PARAMETER_BUFFER_ARB, draw_counts_buffer);
+			for(uint32_t p=0;p<geometry_heap.page_count();++p) {
+				glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, heap_buffers[p]);
+				glMultiDrawElementsIndirectCountARB(
+					GL_TRIANGLES, GL_UNSIGNED_INT,
+					BUFFER_OFFSET(sizeof(draw_command)*page_draws*p),
+					sizeof(GLuint)*p, page_draws, 0
+				);
+			}
+			glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		};
 
 		glUseProgram(render_program);
 
-		view = cam.get_view();
 		glUniformMatrix4fv(view_uni, 1, GL_FALSE, glm::value_ptr(view));
 		glProgramUniformMatrix4fv(lighting_program, light_view_uni, 1, GL_FALSE, glm::value_ptr(view));
 		glUniform1i(render_spritesheet_uni, 0);
@@ -1128,43 +1758,17 @@ int main()
 		glViewport(0.f, 0.f, render_size.x, render_size.y);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		for(auto &cv : chunks) {
-			for(auto &c : cv) {
-				c.draw = false;
-			}
-		}
-
-		for(unsigned int i = 0; i < fc_primitives; ++i) {
-			unsigned int x = visible_indices[i].x;
-		 	unsigned int y = visible_indices[i].y;
-		 	chunks[x][y].draw = true;
-		}
-
-		for(auto &gv : chunk_groupings) {
-			for(auto &g : gv) {
-				bool bound = false;
-				size_t sum = 0;
-				for(auto &c : g.chunks) {
-					if(c->draw) {
-						if(!bound) {
-							glBindBuffer(GL_ARRAY_BUFFER, g.merged_geometry);
-							glBindVertexArray(g.vtx_array);
-							bound = true;
-						}
-						glm::mat4 transform;
-						transform = glm::translate(
-							transform,
-							glm::vec3(chunk_size.x, chunk_size.y, chunk_size.z)*
-							glm::vec3(c->position)
-						);
-						glUniformMatrix4fv(
-							model_uni, 1, GL_FALSE, glm::value_ptr(transform)
-						);
-						glDrawArrays(GL_TRIANGLES, sum, c->vertex_count);
-					}
-					sum += c->vertex_count;
-				}
-			}
+		// Sections in front of the last frame's depth are drawn first. The
+		//  ones behind it are tested again against the depth of those, so
+		//  whatever this frame uncovered is drawn right away. The pyramid
+		//  built at the end is the next frame's first test.
+		cull(0);
+		draw_world();
+		if(occlusion_culling) {
+			build_hiz();
+			cull(1);
+			draw_world();
+			build_hiz();
 		}
 
 		glDisable(GL_DEPTH_TEST);
@@ -1203,14 +1807,19 @@ int main()
 		process_gl_errors();
 	}
 
-	glDeleteTextures(1, &empty_chunk.texid);
-	delete empty_chunk.IDs;
-	for(unsigned int x = 0; x < chunks.size(); ++x) {
-		for(unsigned int y = 0; y < chunks[x].size(); ++y) {
-			glDeleteBuffers(1, &(chunks[x][y].buffer_geometry));
-			glDeleteVertexArrays(1, &(chunks[x][y].vtx_array));
-		}
-	}
+	glDeleteBuffers(heap_buffers.size(), heap_buffers.data());
+	glDeleteBuffers(1, &draw_commands_buffer);
+	glDeleteBuffers(1, &draw_counts_buffer);
+	glDeleteBuffers(1, &cull_chunks_buffer);
+	glDeleteBuffers(1, &cull_bounds_buffer);
+	glDeleteBuffers(1, &cull_retest_buffer);
+	glDeleteBuffers(1, &cull_stats_buffer);
+	glDeleteTextures(1, &hiz_texture);
+	glDeleteBuffers(1, &chunk_origins_buffer);
+	glDeleteVertexArrays(1, &quad_vao);
+	glDeleteBuffers(1, &quad_ebo);
+	glDeleteTextures(1, &world_ids);
+	glDeleteBuffers(1, &chunk_slots_buffer);
 
 	// glDeleteFramebuffers(1, &framebuffer);
 	glDeleteShader(shader_render_vert);
@@ -1255,6 +1864,13 @@ int cleanup(int rtval, std::wstring extra)
 			wlog.log(L"Shader compilation failed: ");
 			wlog.log(extra);
 			wlog.log("\n");
+			break;
+		}
+		case -6: {
+			wlog.log(L"Missing OpenGL extension: ");
+			wlog.log(extra);
+			wlog.log(L"\n");
+			break;
 		}
 	}
 	glfwTerminate();
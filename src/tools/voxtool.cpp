@@ -0,0 +1,1268 @@
+// Headless utilities that work on map data without an OpenGL context.
+//
+//  voxtool bench-codecs [-n iterations] region.mca...
+//    Decompresses every chunk of the given region files with each codec
+//    backend that was built in and reports throughput per backend.
+//
+//  voxtool load [-inflate n] [-parse n] [-transpose n] [-queue n] [-rle] region.mca...
+//    Runs the load pipeline without uploading anything and reports where
+//    the time went. With -rle chunks are kept column run-length encoded.
+//    Also reports resident voxel memory, how fast chunks expand back into
+//    texture layout and how many sections are empty, full or mixed.
+//
+//  voxtool bench-load [-j max_workers] region.mca...
+//    Loads the region files with MapLoader::load on job systems of 1, 2,
+//    4... workers and reports the speedup over a single worker.
+//
+//  voxtool dag [-o out.vdag] region.mca...
+//    Builds a VoxelDAG of the region files, checks it against the loaded
+//    chunks and measures point and ray queries. With -o the DAG is written
+//    to a file and read back.
+//
+//  voxtool bench-layout [-n iterations] region.mca...
+//    Times neighbourhood heavy passes over the chunks of the region files
+//    with sections in linear and in Morton order, along with the
+//    conversion between the two.
+//
+//  voxtool mesh [-n iterations] region.mca...
+//    Meshes every loaded chunk with the CPU greedy mesher in parallel and
+//    reports throughput, visible faces and the quads they were merged into.
+//    Checks that the quads cover exactly the visible faces and are split
+//    into directions and sections.
+//
+//  voxtool edit [-n transactions] region.mca...
+//    Meshes every loaded chunk, then applies random transactions of block
+//    edits through EditTracker and remeshes only the dirty sections after
+//    each. Reports the time per transaction and checks that the patched
+//    meshes equal meshing the edited chunks from scratch.
+//
+//  voxtool bake [-o cache.vmc] [-size x y] region.mca...
+//    Fills the mesh cache the viewer loads at startup with the meshes of
+//    every loaded chunk, meshing only the chunks it doesn't hold yet. With
+//    -size only the first x by y chunks are meshed and seen as neighbours,
+//    to match a viewer showing that many chunks. The meshes are the CPU
+//    mesher's, the viewer reads them with -mesher cpu.
+//
+//  voxtool heap [-n operations] [-page quads] region.mca...
+//    Allocates the meshes of every loaded chunk from a GeometryHeap, then
+//    replaces random meshes with smaller or larger ones, defragmenting
+//    pages that become fragmented. Reports allocation speed and heap usage
+//    and checks that no mesh was overwritten or lost.
+//
+//  voxtool selftest
+//    Checks components that don't need region files on generated data.
+//    Prints one line per check and fails if any of them does. make check
+//    runs it.
+
+#include <MapLoader/MapLoader.hpp>
+#include <Codec/Codec.hpp>
+#include <Pipeline/LoadPipeline.hpp>
+#include <Pipeline/BoundedQueue.hpp>
+#include <Jobs/JobSystem.hpp>
+#include <Allocator/SlabAllocator.hpp>
+#include <Allocator/GeometryHeap.hpp>
+#include <VoxelDAG/VoxelDAG.hpp>
+#include <Layout/Morton.hpp>
+#include <Mesher/Mesher.hpp>
+#include <Edit/EditTracker.hpp>
+#include <MeshCache/MeshCache.hpp>
+#include <Storage/PaddedChunk.hpp>
+#include <Storage/RLEChunk.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+namespace {
+	int usage() {
+		std::cerr<<"usage: voxtool <command> [args]\n"
+		         <<"commands:\n"
+		         <<"  bench-codecs [-n iterations] region.mca...\n"
+		         <<"  load [-inflate n] [-parse n] [-transpose n] [-queue n] [-rle] region.mca...\n"
+		         <<"  bench-load [-j max_workers] region.mca...\n"
+		         <<"  dag [-o out.vdag] region.mca...\n"
+		         <<"  bench-layout [-n iterations] region.mca...\n"
+		         <<"  mesh [-n iterations] region.mca...\n"
+		         <<"  edit [-n transactions] region.mca...\n"
+		         <<"  bake [-o cache.vmc] [-size x y] region.mca...\n"
+		         <<"  heap [-n operations] [-page quads] region.mca...\n"
+		         <<"  selftest\n";
+		return 1;
+	}
+
+	int bench_codecs(int argc, char **argv) {
+		int iterations = 5;
+		std::vector<std::string> files;
+		for(int i=0;i<argc;++i) {
+			if(!std::strcmp(argv[i], "-n") && i+1<argc)
+				iterations = std::max(1, std::atoi(argv[++i]));
+			else
+				files.push_back(argv[i]);
+		}
+		if(files.empty())
+			return usage();
+
+		// Group the corpus by compression type, each type is benchmarked
+		//  against all of its backends.
+		std::map<uint8_t, std::vector<MC::RawChunk>> corpus;
+		for(auto &f : files) {
+			std::unique_ptr<MC::Region> region(new MC::Region);
+			std::vector<MC::RawChunk> raw_chunks;
+			if(!MapLoader::read_region(f, *region, raw_chunks)) {
+				std::cerr<<"Could not read "<<f<<std::endl;
+				continue;
+			}
+			for(auto &raw : raw_chunks)
+				corpus[raw.compression].push_back(std::move(raw));
+		}
+
+		std::vector<uint8_t> scratch(4*1024*1024);
+		for(auto &type : corpus) {
+			size_t compressed_bytes = 0;
+			for(auto &raw : type.second)
+				compressed_bytes += raw.data.size();
+
+			std::cout<<"Compression type "<<static_cast<int>(type.first)
+				<<": "<<type.second.size()<<" chunks, "
+				<<compressed_bytes<<" bytes compressed"<<std::endl;
+
+			auto backends = Codec::backends(type.first);
+			if(backends.empty())
+				std::cout<<"  no backend available"<<std::endl;
+
+			for(auto codec : backends) {
+				size_t uncompressed_bytes = 0;
+				size_t failures = 0;
+				auto start = std::chrono::high_resolution_clock::now();
+				for(int it=0;it<iterations;++it) {
+					for(auto &raw : type.second) {
+						size_t len;
+						if(codec->decompress(raw.data.data(), raw.data.size(), scratch, len))
+							uncompressed_bytes += len;
+						else
+							++failures;
+					}
+				}
+				auto end = std::chrono::high_resolution_clock::now();
+				double seconds = std::chrono::duration<double>(end-start).count();
+				std::cout<<"  "<<std::setw(16)<<std::left<<codec->name()<<std::right
+					<<std::fixed<<std::setprecision(1)
+					<<std::setw(10)<<compressed_bytes*iterations/seconds/1e6<<" MB/s in, "
+					<<std::setw(10)<<uncompressed_bytes/seconds/1e6<<" MB/s out, "
+					<<std::setw(8)<<seconds*1e6/(type.second.size()*iterations)<<" us/chunk";
+				if(failures)
+					std::cout<<", "<<failures<<" failures";
+				std::cout<<std::endl;
+			}
+		}
+		return 0;
+	}
+
+	// Region files are named r.<x>.<z>.mca, files that don't follow that
+	//  pattern are placed next to each other along x.
+	void region_coords(const std::string &path, int fallback, int &x, int &y) {
+		std::string name = path.substr(path.find_last_of('/')+1);
+		if(std::sscanf(name.c_str(), "r.%d.%d.mca", &x, &y) != 2 || x < 0 || y < 0) {
+			x = fallback;
+			y = 0;
+		}
+	}
+
+	// Sums what every loaded chunk holds and times expanding all of them,
+	//  as done for every texture upload.
+	void report_resident(const MapLoader &map) {
+		std::vector<const MC::Chunk*> chunks;
+		size_t bytes = 0;
+		size_t occupancy[3] = {0, 0, 0};
+		for(auto &row : map.regions) {
+			for(auto &region : row) {
+				for(auto &chunk : region.chunks) {
+					if(!chunk.loaded)
+						continue;
+					chunks.push_back(&chunk);
+					bytes += chunk.memory_usage();
+					for(size_t s=0;s<MC::Chunk::section_count;++s)
+						++occupancy[static_cast<int>(chunk.occupancy(s))];
+				}
+			}
+		}
+		if(chunks.empty())
+			return;
+
+		VoxelBuffer voxels(MC::Chunk::size);
+		auto t0 = std::chrono::high_resolution_clock::now();
+		for(auto chunk : chunks)
+			chunk->expand(voxels.data());
+		auto t1 = std::chrono::high_resolution_clock::now();
+		double seconds = std::chrono::duration<double>(t1-t0).count();
+
+		double mib = bytes/(1024.0*1024.0);
+		double raw_mib = chunks.size()*MC::Chunk::size/(1024.0*1024.0);
+		std::cout<<std::fixed<<std::setprecision(1)
+		         <<"Resident voxels: "<<mib<<" MiB in "<<chunks.size()<<" chunks, "
+		         <<raw_mib<<" MiB unencoded ("<<raw_mib/std::max(mib, 1e-9)<<"x)"
+		         <<(chunks.front()->storage == MC::Storage::COLUMN_RLE ? ", column RLE" : ", sections")
+		         <<"\n"
+		         <<"Expand: "<<chunks.size()/seconds<<" chunks/s, "
+		         <<raw_mib/seconds<<" MiB/s\n"
+		         <<"Sections: "<<occupancy[0]<<" empty, "<<occupancy[1]<<" full, "
+		         <<occupancy[2]<<" mixed"<<std::endl;
+	}
+
+	int load(int argc, char **argv) {
+		LoadPipeline::Config config;
+		MC::Storage storage = MC::Storage::SECTIONS;
+		std::vector<std::string> files;
+		for(int i=0;i<argc;++i) {
+			std::string arg = argv[i];
+			if(i+1<argc && arg == "-inflate")
+				config.inflate_workers = std::atoi(argv[++i]);
+			else if(i+1<argc && arg == "-parse")
+				config.parse_workers = std::atoi(argv[++i]);
+			else if(i+1<argc && arg == "-transpose")
+				config.transpose_workers = std::atoi(argv[++i]);
+			else if(i+1<argc && arg == "-queue")
+				config.queue_capacity = std::atoi(argv[++i]);
+			else if(arg == "-rle")
+				storage = MC::Storage::COLUMN_RLE;
+			else
+				files.push_back(arg);
+		}
+		if(files.empty())
+			return usage();
+
+		MapLoader map;
+		map.storage = storage;
+		LoadPipeline pipeline(map, config);
+		for(size_t i=0;i<files.size();++i) {
+			int x, y;
+			region_coords(files[i], i, x, y);
+			pipeline.add_region(files[i], x, y);
+		}
+		pipeline.start();
+
+		size_t loaded = 0;
+		while(!pipeline.finished())
+			loaded += pipeline.poll_wait([](int, int, uint32_t, MC::Chunk&){}, 1024);
+		std::cout<<"Loaded "<<loaded<<" chunks"<<std::endl;
+		std::cout<<pipeline.report();
+		std::cout<<"Voxel pools:\n"<<SlabAllocator::report();
+		std::cout<<SectionStore::global().report();
+		report_resident(map);
+		return 0;
+	}
+
+	int bench_load(int argc, char **argv) {
+		size_t max_workers = std::max(1u, std::thread::hardware_concurrency());
+		std::vector<std::string> files;
+		for(int i=0;i<argc;++i) {
+			if(!std::strcmp(argv[i], "-j") && i+1<argc)
+				max_workers = std::max(1, std::atoi(argv[++i]));
+			else
+				files.push_back(argv[i]);
+		}
+		if(files.empty())
+			return usage();
+
+		double single = 0.0;
+		for(size_t workers=1;;workers*=2) {
+			workers = std::min(workers, max_workers);
+			JobSystem jobs(workers);
+			MapLoader map;
+			auto start = std::chrono::high_resolution_clock::now();
+			for(size_t i=0;i<files.size();++i) {
+				int x, y;
+				region_coords(files[i], i, x, y);
+				map.load(files[i], x, y, jobs);
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+			double seconds = std::chrono::duration<double>(end-start).count();
+			if(workers == 1)
+				single = seconds;
+			std::cout<<std::setw(4)<<workers<<" workers: "
+				<<std::fixed<<std::setprecision(3)<<seconds<<"s, speedup "
+				<<std::setprecision(2)<<single/seconds<<"x"<<std::endl;
+			if(workers == max_workers)
+				break;
+		}
+		return 0;
+	}
+
+	// Random voxels compared between the DAG and the chunks it was built from
+	size_t check_dag(const VoxelDAG &dag, const MapLoader &map, size_t samples) {
+		std::mt19937 rng(1);
+		size_t mismatches = 0;
+		for(size_t i=0;i<samples;++i) {
+			int x = rng()%(16*dag.chunks_x());
+			int y = rng()%(16*dag.chunks_y());
+			int z = rng()%256;
+			int cx = x/16;
+			int cy = y/16;
+			const MC::Chunk &chunk = map.regions[cx/32][cy/32].chunks[(cy%32)*32 + cx%32];
+			uint8_t expected = chunk.loaded ? chunk.get(x%16, y%16, z) : 0;
+			if(dag.get(x, y, z) != expected)
+				++mismatches;
+		}
+		return mismatches;
+	}
+
+	int dag(int argc, char **argv) {
+		std::string output;
+		std::vector<std::string> files;
+		for(int i=0;i<argc;++i) {
+			std::string arg = argv[i];
+			if(i+1<argc && arg == "-o")
+				output = argv[++i];
+			else
+				files.push_back(arg);
+		}
+		if(files.empty())
+			return usage();
+
+		MapLoader map;
+		for(size_t i=0;i<files.size();++i) {
+			int x, y;
+			region_coords(files[i], i, x, y);
+			map.load(files[i], x, y);
+		}
+
+		VoxelDAG dag;
+		auto t0 = std::chrono::high_resolution_clock::now();
+		dag.build(map);
+		auto t1 = std::chrono::high_resolution_clock::now();
+		std::cout<<"Built in "<<std::fixed<<std::setprecision(3)
+			<<std::chrono::duration<double>(t1-t0).count()<<"s"<<std::endl;
+		std::cout<<dag.report();
+		if(!dag.depth())
+			return 1;
+
+		const size_t samples = 1000000;
+		t0 = std::chrono::high_resolution_clock::now();
+		size_t mismatches = check_dag(dag, map, samples);
+		t1 = std::chrono::high_resolution_clock::now();
+		std::cout<<"Point queries: "<<std::setprecision(1)
+			<<samples/std::chrono::duration<double>(t1-t0).count()/1e6<<" M/s including the "
+			<<"chunk lookups, "<<mismatches<<" mismatches"<<std::endl;
+
+		// Rays from above the map looking down at random angles
+		std::mt19937 rng(2);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		const size_t rays = 200000;
+		size_t hits = 0;
+		t0 = std::chrono::high_resolution_clock::now();
+		for(size_t i=0;i<rays;++i) {
+			float origin[3] = {
+				unit(rng)*16*dag.chunks_x(), unit(rng)*16*dag.chunks_y(), -8.0f
+			};
+			float direction[3] = {unit(rng)-0.5f, unit(rng)-0.5f, 1.0f};
+			VoxelDAG::Hit hit;
+			if(dag.raycast(origin, direction, 1000.0f, hit))
+				++hits;
+		}
+		t1 = std::chrono::high_resolution_clock::now();
+		std::cout<<"Ray queries: "<<std::setprecision(2)
+			<<rays/std::chrono::duration<double>(t1-t0).count()/1e6<<" M/s, "
+			<<hits<<" of "<<rays<<" hit"<<std::endl;
+
+		if(!output.empty()) {
+			VoxelDAG loaded;
+			if(!dag.serialize(output) || !loaded.deserialize(output)) {
+				std::cerr<<"Could not write and read back "<<output<<std::endl;
+				return 1;
+			}
+			std::ifstream file(output, std::ios::binary | std::ios::ate);
+			std::cout<<"Wrote "<<output<<", "<<file.tellg()<<" bytes, "
+				<<check_dag(loaded, map, samples)<<" mismatches after reading back"<<std::endl;
+		}
+		return 0;
+	}
+
+	struct LinearIndex {
+		size_t operator()(int x, int y, int z) const {
+			return z*16*16 + y*16 + x;
+		}
+	};
+	struct MortonIndex {
+		size_t operator()(int x, int y, int z) const {
+			return (z>>4)*SectionData::size + Morton::encode(x, y, z&15);
+		}
+	};
+
+	// Counts the faces between solid and air voxels within each chunk, as
+	//  a mesher does.
+	template<typename Index>
+	uint64_t count_faces(const std::vector<VoxelBuffer> &chunks, Index index) {
+		uint64_t faces = 0;
+		for(auto &chunk : chunks) {
+			const uint8_t *v = chunk.data();
+			for(int z=0;z<256;++z) {
+				for(int y=0;y<16;++y) {
+					for(int x=0;x<16;++x) {
+						if(!v[index(x, y, z)])
+							continue;
+						faces += x ==   0 || !v[index(x-1, y, z)];
+						faces += x ==  15 || !v[index(x+1, y, z)];
+						faces += y ==   0 || !v[index(x, y-1, z)];
+						faces += y ==  15 || !v[index(x, y+1, z)];
+						faces += z ==   0 || !v[index(x, y, z-1)];
+						faces += z == 255 || !v[index(x, y, z+1)];
+					}
+				}
+			}
+		}
+		return faces;
+	}
+
+	// Sums the solid voxels in the 3x3x3 block around every voxel, as
+	//  ambient occlusion does.
+	template<typename Index>
+	uint64_t count_occlusion(const std::vector<VoxelBuffer> &chunks, Index index) {
+		uint64_t occluders = 0;
+		for(auto &chunk : chunks) {
+			const uint8_t *v = chunk.data();
+			for(int z=1;z<255;++z) {
+				for(int y=1;y<15;++y) {
+					for(int x=1;x<15;++x) {
+						for(int dz=-1;dz<=1;++dz)
+							for(int dy=-1;dy<=1;++dy)
+								for(int dx=-1;dx<=1;++dx)
+									occluders += v[index(x+dx, y+dy, z+dz)] != 0;
+					}
+				}
+			}
+		}
+		return occluders;
+	}
+
+	int bench_layout(int argc, char **argv) {
+		int iterations = 3;
+		std::vector<std::string> files;
+		for(int i=0;i<argc;++i) {
+			if(!std::strcmp(argv[i], "-n") && i+1<argc)
+				iterations = std::max(1, std::atoi(argv[++i]));
+			else
+				files.push_back(argv[i]);
+		}
+		if(files.empty())
+			return usage();
+
+		MapLoader map;
+		for(size_t i=0;i<files.size();++i) {
+			int x, y;
+			region_coords(files[i], i, x, y);
+			map.load(files[i], x, y);
+		}
+		std::vector<VoxelBuffer> linear;
+		for(auto &row : map.regions) {
+			for(auto &region : row) {
+				for(auto &chunk : region.chunks) {
+					if(!chunk.loaded)
+						continue;
+					linear.emplace_back(MC::Chunk::size);
+					chunk.expand(linear.back().data());
+				}
+			}
+		}
+		if(linear.empty())
+			return 1;
+
+		std::vector<VoxelBuffer> morton(linear.size(), VoxelBuffer(MC::Chunk::size));
+		auto time = [&](const char *name, const std::function<uint64_t()> &f) {
+			uint64_t result = 0;
+			auto start = std::chrono::high_resolution_clock::now();
+			for(int it=0;it<iterations;++it)
+				result = f();
+			auto end = std::chrono::high_resolution_clock::now();
+			double seconds = std::chrono::duration<double>(end-start).count()/iterations;
+			std::cout<<"  "<<std::setw(24)<<std::left<<name<<std::right
+				<<std::fixed<<std::setprecision(3)<<std::setw(10)<<seconds*1e3<<" ms, "
+				<<std::setw(10)<<std::setprecision(1)<<linear.size()/seconds<<" chunks/s"
+				<<" ("<<result<<")"<<std::endl;
+		};
+
+		std::cout<<linear.size()<<" chunks, built with "
+			<<(SectionData::morton ? "Morton" : "linear")<<" sections"
+#ifdef __BMI2__
+			<<", BMI2"
+#endif
+			<<std::endl;
+		time("linear to Morton", [&]{
+			for(size_t c=0;c<linear.size();++c) {
+				for(size_t s=0;s<MC::Chunk::section_count;++s) {
+					size_t offset = s*SectionData::size;
+					Morton::from_linear(linear[c].data() + offset, morton[c].data() + offset);
+				}
+			}
+			return static_cast<uint64_t>(0);
+		});
+		time("Morton to linear", [&]{
+			static VoxelBuffer out(MC::Chunk::size);
+			for(size_t c=0;c<morton.size();++c) {
+				for(size_t s=0;s<MC::Chunk::section_count;++s) {
+					size_t offset = s*SectionData::size;
+					Morton::to_linear(morton[c].data() + offset, out.data() + offset);
+				}
+			}
+			return static_cast<uint64_t>(0);
+		});
+		time("faces, linear", [&]{ return count_faces(linear, LinearIndex()); });
+		time("faces, Morton", [&]{ return count_faces(morton, MortonIndex()); });
+		time("occlusion, linear", [&]{ return count_occlusion(linear, LinearIndex()); });
+		time("occlusion, Morton", [&]{ return count_occlusion(morton, MortonIndex()); });
+		return 0;
+	}
+
+	// Area of every quad of a mesh, in voxel faces
+	uint64_t quad_area(const std::vector<Mesher::Quad> &mesh) {
+		uint64_t area = 0;
+		for(const Mesher::Quad &quad : mesh)
+			area += quad.width()*quad.height();
+		return area;
+	}
+
+	// Whether the quads are sorted by direction and section, stay inside
+	//  their section and match the per-range counts
+	bool ranges_match(const std::vector<Mesher::Quad> &mesh, const Mesher::Stats &stats) {
+		size_t i = 0;
+		for(int n=0;n<Mesher::directions;++n) {
+			for(int s=0;s<Mesher::sections;++s) {
+				for(uint32_t q=0;q<stats.range_quads[n][s];++q,++i) {
+					const Mesher::Quad &quad = mesh[i];
+					int last_z = (quad.packed >> 8 & 255);
+					if(Mesher::Quad::v_axis(n) == 2)
+						last_z += quad.height()-1;
+					if(quad.direction() != n || quad.section() != s || last_z/16 != s)
+						return false;
+				}
+			}
+		}
+		return i == mesh.size();
+	}
+
+	int mesh(int argc, char **argv) {
+		int iterations = 3;
+		std::vector<std::string> files;
+		for(int i=0;i<argc;++i) {
+			if(!std::strcmp(argv[i], "-n") && i+1<argc)
+				iterations = std::max(1, std::atoi(argv[++i]));
+			else
+				files.push_back(argv[i]);
+		}
+		if(files.empty())
+			return usage();
+
+		MapLoader map;
+		for(size_t i=0;i<files.size();++i) {
+			int x, y;
+			region_coords(files[i], i, x, y);
+			map.load(files[i], x, y);
+		}
+		// Chunks by map chunk coordinates, missing ones are air
+		auto chunk_at = [&](int x, int y) -> const MC::Chunk* {
+			if(x < 0 || y < 0 || size_t(x/32) >= map.regions.size())
+				return nullptr;
+			auto &column = map.regions[x/32];
+			if(size_t(y/32) >= column.size())
+				return nullptr;
+			const MC::Chunk &chunk = column[y/32].chunks[(y%32)*32 + x%32];
+			return chunk.loaded ? &chunk : nullptr;
+		};
+		std::vector<std::pair<int, int>> loaded;
+		for(size_t rx=0;rx<map.regions.size();++rx) {
+			for(size_t ry=0;ry<map.regions[rx].size();++ry) {
+				for(int i=0;i<1024;++i) {
+					if(map.regions[rx][ry].chunks[i].loaded)
+						loaded.emplace_back(rx*32 + i%32, ry*32 + i/32);
+				}
+			}
+		}
+		if(loaded.empty())
+			return 1;
+
+		std::vector<std::vector<Mesher::Quad>> meshes(loaded.size());
+		std::vector<Mesher::Stats> stats(loaded.size());
+		auto start = std::chrono::high_resolution_clock::now();
+		for(int it=0;it<iterations;++it) {
+			JobSystem::global().parallel_for(0, loaded.size(), 1, [&](size_t i) {
+				static thread_local PaddedChunk padded;
+				int x = loaded[i].first, y = loaded[i].second;
+				padded.fill(x, y, chunk_at);
+				meshes[i].clear();
+				stats[i] = Mesher::mesh(padded, meshes[i]);
+			});
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		double seconds = std::chrono::duration<double>(end-start).count()/iterations;
+
+		uint64_t faces = 0, quads = 0, area = 0, bytes = 0;
+		bool ranges = true;
+		for(size_t i=0;i<loaded.size();++i) {
+			ranges = ranges && ranges_match(meshes[i], stats[i]);
+			faces += stats[i].faces;
+			quads += stats[i].quads;
+			area += quad_area(meshes[i]);
+			bytes += meshes[i].size()*sizeof(Mesher::Quad);
+		}
+		std::cout<<loaded.size()<<" chunks on "<<JobSystem::global().worker_count()
+			<<" workers: "<<std::fixed<<std::setprecision(3)<<seconds*1e3<<" ms, "
+			<<std::setprecision(1)<<loaded.size()/seconds<<" chunks/s\n"
+			<<"  "<<faces<<" faces merged into "<<quads<<" quads ("
+			<<std::setprecision(2)<<(quads ? double(faces)/quads : 0.0)<<" faces per quad), "
+			<<bytes/1024<<" KiB of quads"<<std::endl;
+		if(area != faces) {
+			std::cerr<<"quads cover "<<area<<" faces, expected "<<faces<<std::endl;
+			return 1;
+		}
+		if(!ranges) {
+			std::cerr<<"quads are not split into directions and sections"<<std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	int edit(int argc, char **argv) {
+		int transactions = 1000;
+		std::vector<std::string> files;
+		for(int i=0;i<argc;++i) {
+			if(!std::strcmp(argv[i], "-n") && i+1<argc)
+				transactions = std::max(1, std::atoi(argv[++i]));
+			else
+				files.push_back(argv[i]);
+		}
+		if(files.empty())
+			return usage();
+
+		MapLoader map;
+		for(size_t i=0;i<files.size();++i) {
+			int x, y;
+			region_coords(files[i], i, x, y);
+			map.load(files[i], x, y);
+		}
+		int chunks_x = map.regions.size()*32;
+		int chunks_y = 0;
+		for(auto &column : map.regions)
+			chunks_y = std::max(chunks_y, int(column.size())*32);
+		auto chunk_at = [&](int x, int y) -> MC::Chunk* {
+			if(x < 0 || y < 0 || x >= chunks_x || size_t(y/32) >= map.regions[x/32].size())
+				return nullptr;
+			MC::Chunk &chunk = map.regions[x/32][y/32].chunks[(y%32)*32 + x%32];
+			return chunk.loaded ? &chunk : nullptr;
+		};
+		// Meshes and their range counts by chunk number
+		struct ChunkMesh {
+			std::vector<Mesher::Quad> quads;
+			uint32_t range_quads[Mesher::directions][Mesher::sections];
+		};
+		std::vector<ChunkMesh> meshes(chunks_x*chunks_y);
+		std::vector<std::pair<int, int>> loaded;
+		PaddedChunk padded;
+		for(int x=0;x<chunks_x;++x) {
+			for(int y=0;y<chunks_y;++y) {
+				if(!chunk_at(x, y))
+					continue;
+				loaded.emplace_back(x, y);
+				ChunkMesh &mesh = meshes[x*chunks_y + y];
+				padded.fill(x, y, chunk_at);
+				Mesher::Stats stats = Mesher::mesh(padded, mesh.quads);
+				std::memcpy(mesh.range_quads, stats.range_quads, sizeof(mesh.range_quads));
+			}
+		}
+		if(loaded.empty())
+			return 1;
+
+		// Each transaction fills or digs out a box of up to 4x4x4 blocks
+		//  somewhere in a loaded chunk, crossing chunk and section borders
+		//  often enough
+		EditTracker tracker(chunks_x, chunks_y, chunk_at);
+		std::mt19937 rng(1);
+		uint64_t changed = 0, remeshed_chunks = 0, remeshed_sections = 0, uploaded = 0;
+		double apply_seconds = 0, remesh_seconds = 0;
+		for(int t=0;t<transactions;++t) {
+			auto chunk = loaded[rng()%loaded.size()];
+			int x0 = chunk.first*16 + rng()%16;
+			int y0 = chunk.second*16 + rng()%16;
+			int z0 = rng()%256;
+			int size[3] = {int(rng()%4)+1, int(rng()%4)+1, int(rng()%4)+1};
+			uint8_t id = rng()%2 ? 0 : 1 + rng()%8;
+			EditTracker::Transaction transaction;
+			for(int z=z0;z<z0+size[2];++z) {
+				for(int y=y0;y<y0+size[1];++y) {
+					for(int x=x0;x<x0+size[0];++x)
+						transaction.set_block(x, y, z, id);
+				}
+			}
+
+			auto start = std::chrono::high_resolution_clock::now();
+			changed += tracker.apply(transaction);
+			auto applied = std::chrono::high_resolution_clock::now();
+			int x, y, min[3], max[3];
+			while(tracker.next_upload(x, y, min, max))
+				uploaded += (max[0]-min[0]+1)*(max[1]-min[1]+1)*(max[2]-min[2]+1);
+			uint16_t sections;
+			while(tracker.next_remesh(x, y, sections)) {
+				if(!chunk_at(x, y))
+					continue;
+				ChunkMesh &mesh = meshes[x*chunks_y + y];
+				padded.fill(x, y, chunk_at);
+				Mesher::remesh(padded, sections, mesh.quads, mesh.range_quads);
+				++remeshed_chunks;
+				remeshed_sections += __builtin_popcount(sections);
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+			apply_seconds += std::chrono::duration<double>(applied-start).count();
+			remesh_seconds += std::chrono::duration<double>(end-applied).count();
+		}
+
+		// The patched meshes have to match meshing the edited world again
+		size_t mismatched = 0;
+		std::vector<Mesher::Quad> full;
+		for(auto &chunk : loaded) {
+			const ChunkMesh &mesh = meshes[chunk.first*chunks_y + chunk.second];
+			padded.fill(chunk.first, chunk.second, chunk_at);
+			full.clear();
+			Mesher::Stats stats = Mesher::mesh(padded, full);
+			bool same = full.size() == mesh.quads.size()
+				&& !std::memcmp(stats.range_quads, mesh.range_quads, sizeof(mesh.range_quads));
+			for(size_t q=0;same && q<full.size();++q)
+				same = full[q].packed == mesh.quads[q].packed && full[q].id == mesh.quads[q].id;
+			if(!same)
+				++mismatched;
+		}
+
+		std::cout<<transactions<<" transactions changed "<<changed<<" blocks, "
+			<<uploaded<<" voxels to upload\n"
+			<<"  apply: "<<std::fixed<<std::setprecision(2)<<apply_seconds*1e6/transactions
+			<<" us per transaction\n"
+			<<"  remesh: "<<remesh_seconds*1e6/transactions<<" us per transaction, "
+			<<remeshed_sections<<" sections of "<<remeshed_chunks<<" chunks, "
+			<<(remeshed_sections ? remesh_seconds*1e6/remeshed_sections : 0.0)<<" us per section"
+			<<std::endl;
+		if(mismatched) {
+			std::cerr<<mismatched<<" of "<<loaded.size()
+				<<" chunks differ from a full remesh"<<std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	int bake(int argc, char **argv) {
+		std::string output = "./assets/mesh_cache.vmc";
+		int size_x = -1, size_y = -1;
+		std::vector<std::string> files;
+		for(int i=0;i<argc;++i) {
+			std::string arg = argv[i];
+			if(arg == "-o" && i+1<argc)
+				output = argv[++i];
+			else if(arg == "-size" && i+2<argc) {
+				size_x = std::atoi(argv[++i]);
+				size_y = std::atoi(argv[++i]);
+			}
+			else
+				files.push_back(arg);
+		}
+		if(files.empty())
+			return usage();
+
+		MapLoader map;
+		for(size_t i=0;i<files.size();++i) {
+			int x, y;
+			region_coords(files[i], i, x, y);
+			map.load(files[i], x, y);
+		}
+		int chunks_x = map.regions.size()*32;
+		int chunks_y = 0;
+		for(auto &column : map.regions)
+			chunks_y = std::max(chunks_y, int(column.size())*32);
+		if(size_x >= 0) {
+			chunks_x = std::min(chunks_x, size_x);
+			chunks_y = std::min(chunks_y, size_y);
+		}
+		auto chunk_at = [&](int x, int y) -> const MC::Chunk* {
+			if(x < 0 || y < 0 || x >= chunks_x || y >= chunks_y)
+				return nullptr;
+			if(size_t(y/32) >= map.regions[x/32].size())
+				return nullptr;
+			const MC::Chunk &chunk = map.regions[x/32][y/32].chunks[(y%32)*32 + x%32];
+			return chunk.loaded ? &chunk : nullptr;
+		};
+		std::vector<std::pair<int, int>> loaded;
+		for(int x=0;x<chunks_x;++x) {
+			for(int y=0;y<chunks_y;++y) {
+				if(chunk_at(x, y))
+					loaded.emplace_back(x, y);
+			}
+		}
+		if(loaded.empty())
+			return 1;
+
+		// Meshed on the CPU, so the viewer uses the cache with -mesher cpu
+		MeshCache cache;
+		bool opened = cache.open(output, MeshCache::mesher_id("cpu", {}));
+		auto start = std::chrono::high_resolution_clock::now();
+		// Keys need the padded chunk the mesher would get, so misses are
+		//  meshed right away
+		std::vector<MeshCache::Key> keys(loaded.size());
+		std::vector<std::vector<Mesher::Quad>> meshes(loaded.size());
+		std::vector<Mesher::Stats> stats(loaded.size());
+		std::vector<char> cached(loaded.size());
+		for(size_t i=0;i<loaded.size();++i) {
+			static PaddedChunk padded;
+			int x = loaded[i].first, y = loaded[i].second;
+			padded.fill(x, y, chunk_at);
+			keys[i] = MeshCache::key(padded, true);
+			MeshCache::Entry entry;
+			cached[i] = cache.find(keys[i], entry);
+		}
+		JobSystem::global().parallel_for(0, loaded.size(), 1, [&](size_t i) {
+			if(cached[i])
+				return;
+			static thread_local PaddedChunk padded;
+			int x = loaded[i].first, y = loaded[i].second;
+			padded.fill(x, y, chunk_at);
+			stats[i] = Mesher::mesh(padded, meshes[i], true);
+		});
+		for(size_t i=0;i<loaded.size();++i) {
+			if(!cached[i])
+				cache.store(keys[i], meshes[i].data(), meshes[i].size(), stats[i].range_quads);
+		}
+		bool saved = cache.save(output);
+		auto end = std::chrono::high_resolution_clock::now();
+
+		std::cout<<loaded.size()<<" chunks"<<(opened ? "" : ", no usable cache yet")
+			<<", "<<std::fixed<<std::setprecision(3)
+			<<std::chrono::duration<double>(end-start).count()*1e3<<" ms\n"
+			<<"  "<<cache.report();
+		if(!saved) {
+			std::cerr<<"could not write "<<output<<std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	int heap(int argc, char **argv) {
+		int operations = 100000;
+		uint32_t page_size = 1u << 20;
+		std::vector<std::string> files;
+		for(int i=0;i<argc;++i) {
+			std::string arg = argv[i];
+			if(arg == "-n" && i+1<argc)
+				operations = std::max(1, std::atoi(argv[++i]));
+			else if(arg == "-page" && i+1<argc)
+				page_size = std::max(1, std::atoi(argv[++i]));
+			else
+				files.push_back(arg);
+		}
+		if(files.empty())
+			return usage();
+
+		// Mesh sizes of the loaded chunks, in quads
+		MapLoader map;
+		for(size_t i=0;i<files.size();++i) {
+			int x, y;
+			region_coords(files[i], i, x, y);
+			map.load(files[i], x, y);
+		}
+		std::vector<uint32_t> sizes;
+		PaddedChunk padded;
+		std::vector<Mesher::Quad> mesh;
+		for(auto &column : map.regions) {
+			for(auto &region : column) {
+				for(auto &chunk : region.chunks) {
+					if(!chunk.loaded)
+						continue;
+					padded.clear();
+					padded.set_center(chunk);
+					mesh.clear();
+					sizes.push_back(Mesher::mesh(padded, mesh).quads);
+				}
+			}
+		}
+		if(sizes.empty())
+			return 1;
+
+		// Stands in for the buffers: every element holds the number of the
+		//  mesh it belongs to
+		GeometryHeap heap(page_size);
+		std::vector<std::vector<uint32_t>> pages;
+		std::vector<GeometryHeap::Handle> handles(sizes.size());
+		auto place = [&](size_t m) {
+			handles[m] = heap.allocate(sizes[m]);
+			while(pages.size() < heap.page_count())
+				pages.emplace_back(heap.page_capacity(pages.size()), ~0u);
+			if(sizes[m]) {
+				std::vector<uint32_t> &page = pages[heap.page(handles[m])];
+				std::fill_n(page.begin() + heap.first(handles[m]), sizes[m], m);
+			}
+		};
+		for(size_t m=0;m<sizes.size();++m)
+			place(m);
+		std::cout<<sizes.size()<<" meshes\n  after loading: "<<heap.report();
+
+		// Edits mostly change a mesh by a little, sometimes by a lot
+		std::mt19937 rng(1);
+		std::vector<GeometryHeap::Move> moves;
+		size_t defragmented = 0;
+		uint64_t moved = 0;
+		double defragment_seconds = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for(int op=0;op<operations;++op) {
+			size_t m = rng()%sizes.size();
+			heap.free(handles[m]);
+			handles[m] = GeometryHeap::none;
+			uint32_t size = sizes[m];
+			if(rng()%8)
+				size = std::max<int>(0, int(size) + int(rng()%65) - 32);
+			else
+				size = rng()%(2*size+64);
+			sizes[m] = size;
+			place(m);
+
+			if(op%1024 != 1023)
+				continue;
+			auto defragment_start = std::chrono::high_resolution_clock::now();
+			for(uint32_t p=0;p<heap.page_count();++p) {
+				if(heap.fragmentation(p) < 0.5f)
+					continue;
+				heap.defragment(p, moves);
+				std::vector<uint32_t> page(pages[p].size(), ~0u);
+				for(const GeometryHeap::Move &move : moves) {
+					std::copy_n(pages[p].begin()+move.from, move.size, page.begin()+move.to);
+					moved += move.size;
+				}
+				pages[p].swap(page);
+				++defragmented;
+			}
+			defragment_seconds += std::chrono::duration<double>(
+				std::chrono::high_resolution_clock::now()-defragment_start
+			).count();
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		double seconds = std::chrono::duration<double>(end-start).count() - defragment_seconds;
+
+		bool intact = heap.check();
+		for(size_t m=0;m<sizes.size() && intact;++m) {
+			if(!sizes[m])
+				continue;
+			const std::vector<uint32_t> &page = pages[heap.page(handles[m])];
+			auto first = page.begin() + heap.first(handles[m]);
+			intact = std::all_of(first, first+sizes[m], [&](uint32_t owner) {
+				return owner == m;
+			});
+		}
+
+		std::cout<<"  after "<<operations<<" replacements: "<<heap.report()
+			<<"  "<<std::fixed<<std::setprecision(3)<<seconds*1e6/operations
+			<<" us per free and allocate, "<<defragmented<<" pages defragmented, "
+			<<moved<<" elements moved in "<<std::setprecision(2)<<defragment_seconds*1e3
+			<<" ms"<<std::endl;
+		if(!intact) {
+			std::cerr<<"allocations overlap or were lost"<<std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	// Compresses generated chunk-like data the way region files do and
+	//  decompresses it with every backend of each compression type.
+	//  Truncated streams have to fail.
+	bool check_codecs(std::string &failed) {
+		std::mt19937 rng(7);
+		std::vector<uint8_t> original(100000);
+		for(size_t i=0;i<original.size();) {
+			size_t run = 1 + rng()%64;
+			uint8_t value = rng()%8;
+			for(;run && i<original.size();--run)
+				original[i++] = value;
+		}
+		bool ok = true;
+		for(uint8_t type : {MC::Compression::GZIP, MC::Compression::ZLIB, MC::Compression::NONE}) {
+			std::vector<uint8_t> compressed;
+			if(type == MC::Compression::NONE)
+				compressed = original;
+			else {
+				z_stream stream{};
+				deflateInit2(
+					&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+					type == MC::Compression::GZIP ? 16+MAX_WBITS : MAX_WBITS, 8, Z_DEFAULT_STRATEGY
+				);
+				compressed.resize(deflateBound(&stream, original.size()));
+				stream.next_in = original.data();
+				stream.avail_in = original.size();
+				stream.next_out = compressed.data();
+				stream.avail_out = compressed.size();
+				deflate(&stream, Z_FINISH);
+				compressed.resize(stream.total_out);
+				deflateEnd(&stream);
+			}
+			for(const Codec *codec : Codec::backends(type)) {
+				// Too small on purpose, decompress has to grow it
+				std::vector<uint8_t> out(16);
+				size_t len = 0;
+				bool round_trip = codec->decompress(compressed.data(), compressed.size(), out, len)
+					&& len == original.size()
+					&& std::equal(original.begin(), original.end(), out.begin());
+				bool truncated = type != MC::Compression::NONE
+					&& codec->decompress(compressed.data(), compressed.size()/2, out, len);
+				if(!round_trip || truncated) {
+					failed += std::string(failed.empty() ? "" : ", ") + codec->name();
+					ok = false;
+				}
+			}
+		}
+		return ok;
+	}
+
+	// Several producers and consumers on a queue much smaller than what
+	//  goes through it, so both sides have to sleep. Every element arrives
+	//  exactly once and each producer's elements arrive in order.
+	bool check_bounded_queue() {
+		BoundedQueue<uint64_t> small(3);
+		uint64_t value = 1;
+		bool ok = small.capacity() == 4;
+		for(int i=0;i<4;++i)
+			ok = ok && small.try_push(value);
+		ok = ok && !small.try_push(value);
+		for(int i=0;i<4;++i)
+			ok = ok && small.try_pop(value);
+		ok = ok && !small.try_pop(value);
+
+		const int producers = 4;
+		const int consumers = 3;
+		const uint64_t per_producer = 20000;
+		BoundedQueue<uint64_t> queue(8);
+		std::vector<std::thread> threads;
+		for(int p=0;p<producers;++p) {
+			threads.emplace_back([&queue, p, per_producer] {
+				for(uint64_t i=0;i<per_producer;++i) {
+					uint64_t element = uint64_t(p) << 32 | i;
+					queue.push(element);
+				}
+			});
+		}
+		std::vector<std::vector<uint64_t>> received(consumers);
+		std::vector<std::thread> consumer_threads;
+		for(int c=0;c<consumers;++c) {
+			consumer_threads.emplace_back([&queue, &received, c] {
+				uint64_t element;
+				while(queue.pop(element))
+					received[c].push_back(element);
+			});
+		}
+		for(auto &thread : threads)
+			thread.join();
+		queue.close();
+		for(auto &thread : consumer_threads)
+			thread.join();
+
+		std::vector<uint64_t> count(producers, 0);
+		for(auto &elements : received) {
+			std::vector<int64_t> last(producers, -1);
+			for(uint64_t element : elements) {
+				int p = element >> 32;
+				int64_t i = element & 0xFFFFFFFF;
+				ok = ok && p < producers && i > last[p];
+				if(p < producers) {
+					last[p] = i;
+					++count[p];
+				}
+			}
+		}
+		for(uint64_t c : count)
+			ok = ok && c == per_producer;
+		return ok;
+	}
+
+	// A task on a worker fills that worker's deque and waits without
+	//  running any of it, so the tasks can only finish if other threads
+	//  steal them
+	bool check_job_stealing() {
+		JobSystem jobs(2);
+		TaskGroup outer;
+		std::atomic<bool> started{false};
+		std::atomic<bool> stolen{false};
+		std::atomic<int> finished{0};
+		const int tasks = 64;
+		jobs.run(outer, [&] {
+			started = true;
+			TaskGroup inner;
+			std::thread::id owner = std::this_thread::get_id();
+			for(int i=0;i<tasks;++i) {
+				jobs.run(inner, [&, owner] {
+					if(std::this_thread::get_id() != owner)
+						stolen = true;
+					++finished;
+				});
+			}
+			auto start = std::chrono::steady_clock::now();
+			while(finished < tasks && std::chrono::steady_clock::now()-start < std::chrono::seconds(10))
+				std::this_thread::yield();
+			jobs.wait(inner);
+		});
+		// Waiting right away could run the task on this thread, which
+		//  isn't a worker and has no deque of its own
+		while(!started)
+			std::this_thread::yield();
+		jobs.wait(outer);
+		return stolen && finished == tasks;
+	}
+
+	// Continuations run after every task of their dependency, count
+	//  towards their own group and can submit more work to it
+	bool check_job_continuations() {
+		JobSystem jobs(3);
+		TaskGroup first, second;
+		std::atomic<int> counter{0};
+		std::atomic<int> seen{-1};
+		std::atomic<int> after{0};
+		for(int i=0;i<100;++i)
+			jobs.run(first, [&] { ++counter; });
+		jobs.then(first, second, [&] {
+			seen = counter.load();
+			for(int i=0;i<10;++i)
+				jobs.run(second, [&] { ++after; });
+		});
+		jobs.wait(second);
+		bool ok = first.done() && second.done() && seen == 100 && after == 10;
+
+		// then on a group that is already done runs right away
+		TaskGroup third;
+		std::atomic<bool> ran{false};
+		jobs.then(first, third, [&] { ran = true; });
+		jobs.wait(third);
+		ok = ok && ran;
+
+		std::vector<uint64_t> values(100000);
+		jobs.parallel_for(0, values.size(), 64, [&](size_t i) { values[i] += i; });
+		for(size_t i=0;i<values.size();++i)
+			ok = ok && values[i] == i;
+		return ok;
+	}
+
+	// Columns of long and single voxel runs, including ones reaching the
+	//  bottom and the top, against get, decode and decode_column
+	bool check_rle_chunk() {
+		std::mt19937 rng(11);
+		std::vector<uint8_t> voxels(RLEChunk::columns*RLEChunk::size_z);
+		for(int c=0;c<RLEChunk::columns;++c) {
+			for(int z=0;z<RLEChunk::size_z;) {
+				int run = c%7 == 0 ? 1 : 1 + rng()%100;
+				uint8_t id = c%5 == 0 ? 0 : rng()%4;
+				for(;run && z<RLEChunk::size_z;--run,++z)
+					voxels[z*RLEChunk::columns + c] = id;
+			}
+		}
+		RLEChunk rle;
+		bool ok = rle.empty();
+		std::vector<uint8_t> decoded(voxels.size(), 1);
+		rle.decode(decoded.data());
+		ok = ok && std::all_of(decoded.begin(), decoded.end(), [](uint8_t v) { return v == 0; });
+
+		rle.encode(voxels.data());
+		rle.decode(decoded.data());
+		ok = ok && !rle.empty() && decoded == voxels;
+		std::vector<uint8_t> column(RLEChunk::size_z);
+		for(int y=0;y<RLEChunk::size_y;++y) {
+			for(int x=0;x<RLEChunk::size_x;++x) {
+				rle.decode_column(x, y, column.data(), 1);
+				for(int z=0;z<RLEChunk::size_z;++z) {
+					uint8_t expected = voxels[z*RLEChunk::columns + y*RLEChunk::size_x + x];
+					ok = ok && rle.get(x, y, z) == expected && column[z] == expected;
+				}
+			}
+		}
+		rle.clear();
+		return ok && rle.empty();
+	}
+
+	// encode and decode are inverses, every code is used once and the
+	//  section conversions round-trip
+	bool check_morton() {
+		bool ok = true;
+		std::vector<bool> used(SectionData::size, false);
+		for(uint32_t z=0;z<16;++z) {
+			for(uint32_t y=0;y<16;++y) {
+				for(uint32_t x=0;x<16;++x) {
+					uint32_t code = Morton::encode(x, y, z);
+					uint32_t dx, dy, dz;
+					Morton::decode(code, dx, dy, dz);
+					ok = ok && code < used.size() && !used[code] && dx == x && dy == y && dz == z;
+					if(code < used.size())
+						used[code] = true;
+				}
+			}
+		}
+		ok = ok && Morton::encode(1, 0, 0) == 1 && Morton::encode(0, 1, 0) == 2
+			&& Morton::encode(0, 0, 1) == 4 && Morton::encode(15, 15, 15) == 4095;
+
+		std::vector<uint8_t> linear(SectionData::size), morton(SectionData::size), back(SectionData::size);
+		for(size_t i=0;i<linear.size();++i)
+			linear[i] = i*7 + (i>>8);
+		Morton::from_linear(linear.data(), morton.data());
+		Morton::to_linear(morton.data(), back.data());
+		ok = ok && back == linear;
+		for(uint32_t z=0;z<16;++z)
+			ok = ok && morton[Morton::encode(3, 9, z)] == linear[z*256 + 9*16 + 3];
+		return ok;
+	}
+
+	int selftest(int argc, char **) {
+		if(argc)
+			return usage();
+		int failures = 0;
+		auto report = [&](const char *name, bool ok, const std::string &detail = "") {
+			std::cout<<(ok ? "ok      " : "FAILED  ")<<name
+				<<(detail.empty() ? "" : " ("+detail+")")<<std::endl;
+			failures += !ok;
+		};
+		std::string failed_codecs;
+		report("codec round-trips", check_codecs(failed_codecs), failed_codecs);
+		report("bounded queue", check_bounded_queue());
+		report("job system stealing", check_job_stealing());
+		report("job system continuations", check_job_continuations());
+		report("RLE chunk", check_rle_chunk());
+		report("Morton order", check_morton());
+		return failures ? 1 : 0;
+	}
+}
+
+int main(int argc, char **argv) {
+	if(argc < 2)
+		return usage();
+
+	std::string command = argv[1];
+	if(command == "bench-codecs")
+		return bench_codecs(argc-2, argv+2);
+	if(command == "load")
+		return load(argc-2, argv+2);
+	if(command == "bench-load")
+		return bench_load(argc-2, argv+2);
+	if(command == "dag")
+		return dag(argc-2, argv+2);
+	if(command == "bench-layout")
+		return bench_layout(argc-2, argv+2);
+	if(command == "mesh")
+		return mesh(argc-2, argv+2);
+	if(command == "edit")
+		return edit(argc-2, argv+2);
+	if(command == "bake")
+		return bake(argc-2, argv+2);
+	if(command == "heap")
+		return heap(argc-2, argv+2);
+	if(command == "selftest")
+		return selftest(argc-2, argv+2);
+
+	return usage();
+}